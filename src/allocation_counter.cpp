@@ -0,0 +1,39 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "allocation_counter.h"
+#include <cstdlib>
+#include <new>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+thread_local size_t allocations = 0;
+
+}
+
+size_t allocation_count() {
+	return allocations;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Replacements of the global allocation functions; the nothrow forms of the
+// standard library forward to these
+
+void *operator new(size_t size) {
+	allocations++;
+	void *p = std::malloc(size > 0 ? size : 1);
+	if (p == nullptr) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
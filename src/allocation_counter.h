@@ -0,0 +1,14 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include <cstddef>
+////////////////////////////////////////////////////////////////////////////////
+
+// Counts the calls to the global operator new. Only linked in the builds
+// configured with RUBIK_COUNT_ALLOCATIONS, which also define the macro of the
+// same name.
+
+// Number of allocations made by the calling thread since it started. The
+// solve thread, the encoders and the driver threads count on their own, so
+// they never show up in the frames of the render loop.
+size_t allocation_count();
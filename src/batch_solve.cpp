@@ -0,0 +1,199 @@
+////////////////////////////////////////////////////////////////////////////////
+// Solvers
+#include "two_phase.h"
+#include "optimal.h"
+#include "notation.h"
+// STL headers
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Solves scrambles read one per line from a file or stdin, without a window.
+// Every line of the output holds the scramble, the solution, its length and
+// the solve time in milliseconds, separated by tabs, in input order. Lines
+// are solved as they are read and printed as soon as the lines before them
+// are, so the output streams. The totals go to stderr.
+//
+// Usage: batch_solve [--optimal] [--threads N] [--max-length N] [--tables DIR] [file]
+//
+// Two-phase solves run side by side on all the threads. Optimal solves run
+// one after the other, each one split across the threads.
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// One line of the input and its result
+struct Item {
+	int line_number;
+	std::string scramble;
+	std::vector<int> moves;
+	std::string error; // not empty if the line could not be solved
+	std::vector<int> solution;
+	double milliseconds;
+	bool done;
+
+	Item() : line_number(0), milliseconds(0), done(false) { }
+};
+
+void usage() {
+	std::cerr << "Usage: batch_solve [--optimal] [--threads N] [--max-length N] [--tables DIR] [file]" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	bool optimal = false;
+	int num_threads = 0;
+	int max_length = -1;
+	std::string tables = DATA_DIR "tables";
+	std::string input;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--optimal") == 0) {
+			optimal = true;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			num_threads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--max-length") == 0 && i + 1 < argc) {
+			max_length = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--tables") == 0 && i + 1 < argc) {
+			tables = argv[++i];
+		}
+		else if (argv[i][0] != '-' && input.empty()) {
+			input = argv[i];
+		}
+		else {
+			usage();
+			return 2;
+		}
+	}
+	if (num_threads <= 0) {
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	if (max_length < 0) {
+		max_length = optimal ? 20 : 22;
+	}
+
+	std::ifstream file;
+	if (!input.empty()) {
+		file.open(input);
+		if (!file.is_open()) {
+			std::cerr << "Could not open " << input << std::endl;
+			return 2;
+		}
+	}
+	std::istream &in = input.empty() ? std::cin : file;
+
+	TwoPhaseSolver two_phase;
+	OptimalSolver optimal_solver;
+	if (optimal ? !optimal_solver.init(tables, num_threads) : !two_phase.init(tables)) {
+		return 2;
+	}
+
+	// Solve one item; the result is checked by replaying it on the scramble
+	auto solve = [&](Item &item) {
+		if (!item.error.empty()) return;
+		OrientedState state;
+		for (int m : item.moves) state.move(m);
+		Clock::time_point start = Clock::now();
+		bool solved = optimal
+			? optimal_solver.solve(state.state, item.solution, max_length)
+			: two_phase.solve(state.state, item.solution, max_length);
+		item.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		// Name the faces as seen after the scramble, which may rotate the cube
+		for (int &m : item.solution) m = state.world_face(m / 3) * 3 + m % 3;
+		for (int m : item.solution) state.move(m);
+		if (!solved) {
+			item.error = "no solution within " + std::to_string(max_length) + " moves";
+		}
+		else if (!state.state.is_solved()) {
+			item.error = "wrong solution " + format_moves(item.solution);
+		}
+	};
+
+	// Items only grow at the back, so the references held by the solves and
+	// the printer stay valid. The deque itself is only touched under the mutex.
+	std::deque<Item> items;
+	bool read_all = false;
+	std::mutex mutex;
+	std::condition_variable changed;
+
+	// Results are printed in input order as soon as they are available
+	int failures = 0;
+	std::cout << std::fixed << std::setprecision(3);
+	std::thread printer([&]() {
+		for (size_t i = 0; ; i++) {
+			const Item *item;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&]() { return i < items.size() ? items[i].done : read_all; });
+				if (i == items.size()) break;
+				item = &items[i];
+			}
+			if (!item->error.empty()) {
+				std::cerr << "Line " << item->line_number << ": " << item->scramble << ": " << item->error << std::endl;
+				failures++;
+				continue;
+			}
+			std::cout << item->scramble << '\t' << format_moves(item->solution) << '\t'
+				<< item->solution.size() << '\t' << item->milliseconds << std::endl;
+		}
+	});
+
+	// Read the scrambles, skipping blank lines and # comments, and schedule
+	// each one as it is read
+	Eigen::NonBlockingThreadPool pool(optimal ? 1 : num_threads);
+	Clock::time_point begin = Clock::now();
+	std::string line;
+	int line_number = 0;
+	while (std::getline(in, line)) {
+		line_number++;
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#') continue;
+		Item item;
+		item.line_number = line_number;
+		item.scramble = line.substr(start, line.find_last_not_of(" \t\r") + 1 - start);
+		std::string token;
+		if (!parse_moves(item.scramble, item.moves, &token)) {
+			item.error = "invalid move '" + token + "'";
+		}
+		Item *queued;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			items.push_back(item);
+			queued = &items.back();
+		}
+		pool.Schedule([&, queued]() {
+			solve(*queued);
+			std::lock_guard<std::mutex> lock(mutex);
+			queued->done = true;
+			changed.notify_one();
+		});
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		read_all = true;
+		changed.notify_one();
+	}
+	printer.join();
+
+	double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+	std::cerr << items.size() - failures << " solved, " << failures << " failed in " << seconds << "s ("
+		<< (items.size() - failures) / seconds << " solves/s on " << num_threads << " threads)" << std::endl;
+	optimal_solver.free();
+	two_phase.free();
+	return failures > 0 ? 1 : 0;
+}
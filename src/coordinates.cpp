@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "coordinates.h"
+#include <algorithm>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Slot index of the first UD-slice edge (FR); the slice edges are FR, FL, BL, BR
+const int first_slice_edge = 8;
+
+// Binomial coefficient
+int c_nk(int n, int k) {
+	if (n < k) return 0;
+	if (k > n / 2) k = n - k;
+	int s = 1;
+	for (int i = n, j = 1; i != n - k; i--, j++) {
+		s = s * i / j;
+	}
+	return s;
+}
+
+void rotate_left(uint8_t *a, int r) {
+	uint8_t t = a[0];
+	for (int i = 0; i < r; i++) a[i] = a[i + 1];
+	a[r] = t;
+}
+
+void rotate_right(uint8_t *a, int r) {
+	uint8_t t = a[r];
+	for (int i = r; i > 0; i--) a[i] = a[i - 1];
+	a[0] = t;
+}
+
+// Rank of the permutation of n values starting at 'base'
+int perm_rank(const uint8_t *values, int n, int base) {
+	uint8_t perm[NUM_EDGES];
+	std::copy(values, values + n, perm);
+	int b = 0;
+	for (int j = n - 1; j > 0; j--) {
+		int k = 0;
+		while (perm[j] != j + base) {
+			rotate_left(perm, j);
+			k++;
+		}
+		b = (j + 1) * b + k;
+	}
+	return b;
+}
+
+// Inverse of perm_rank
+void perm_unrank(uint8_t *values, int n, int base, int idx) {
+	for (int j = 0; j < n; j++) values[j] = j + base;
+	for (int j = 0; j < n; j++) {
+		int k = idx % (j + 1);
+		idx /= j + 1;
+		while (k-- > 0) rotate_right(values, j);
+	}
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int twist_coord(const CubeState &state) {
+	int twist = 0;
+	for (int i = 0; i < NUM_CORNERS - 1; i++) {
+		twist = 3 * twist + state.co[i];
+	}
+	return twist;
+}
+
+int flip_coord(const CubeState &state) {
+	int flip = 0;
+	for (int i = 0; i < NUM_EDGES - 1; i++) {
+		flip = 2 * flip + state.eo[i];
+	}
+	return flip;
+}
+
+int slice_sorted_coord(const CubeState &state) {
+	uint8_t edge4[4];
+	int a = 0, x = 0;
+	for (int j = NUM_EDGES - 1; j >= 0; j--) {
+		if (state.ep[j] >= first_slice_edge) {
+			a += c_nk(11 - j, x + 1);
+			edge4[3 - x] = state.ep[j];
+			x++;
+		}
+	}
+	return N_PERM_4 * a + perm_rank(edge4, 4, first_slice_edge);
+}
+
+int corners_coord(const CubeState &state) {
+	return perm_rank(state.cp, NUM_CORNERS, 0);
+}
+
+int ud_edges_coord(const CubeState &state) {
+	return perm_rank(state.ep, 8, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void set_twist(CubeState &state, int twist) {
+	int parity = 0;
+	for (int i = NUM_CORNERS - 2; i >= 0; i--) {
+		state.co[i] = twist % 3;
+		parity += state.co[i];
+		twist /= 3;
+	}
+	state.co[NUM_CORNERS - 1] = (3 - parity % 3) % 3;
+}
+
+void set_flip(CubeState &state, int flip) {
+	int parity = 0;
+	for (int i = NUM_EDGES - 2; i >= 0; i--) {
+		state.eo[i] = flip % 2;
+		parity += state.eo[i];
+		flip /= 2;
+	}
+	state.eo[NUM_EDGES - 1] = parity % 2;
+}
+
+void set_slice_sorted(CubeState &state, int idx) {
+	uint8_t slice_edge[4] = {8, 9, 10, 11};
+	uint8_t other_edge[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+	int b = idx % N_PERM_4;
+	int a = idx / N_PERM_4;
+	for (int j = 1; j < 4; j++) {
+		int k = b % (j + 1);
+		b /= j + 1;
+		while (k-- > 0) rotate_right(slice_edge, j);
+	}
+	for (int e = 0; e < NUM_EDGES; e++) state.ep[e] = 0xff;
+	int x = 4;
+	for (int j = 0; j < NUM_EDGES && x > 0; j++) {
+		if (a - c_nk(11 - j, x) >= 0) {
+			state.ep[j] = slice_edge[4 - x];
+			a -= c_nk(11 - j, x);
+			x--;
+		}
+	}
+	x = 0;
+	for (int j = 0; j < NUM_EDGES; j++) {
+		if (state.ep[j] == 0xff) state.ep[j] = other_edge[x++];
+	}
+}
+
+void set_corners(CubeState &state, int idx) {
+	perm_unrank(state.cp, NUM_CORNERS, 0, idx);
+}
+
+void set_ud_edges(CubeState &state, int idx) {
+	perm_unrank(state.ep, 8, 0, idx);
+	for (int e = 8; e < NUM_EDGES; e++) state.ep[e] = e;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Fill a move table by applying every move to a representative of each coordinate
+void build_move_table(std::vector<uint16_t> &table, int size,
+	void (*set)(CubeState &, int), int (*get)(const CubeState &),
+	const int *moves, int num_moves)
+{
+	table.assign(size * NUM_MOVES, 0);
+	for (int c = 0; c < size; c++) {
+		for (int i = 0; i < num_moves; i++) {
+			CubeState state;
+			set(state, c);
+			state.move(moves[i]);
+			table[c * NUM_MOVES + moves[i]] = get(state);
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "cube_state.h"
+#include <cstdint>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Coordinate sizes
+#define N_TWIST 2187         // 3^7 corner orientations
+#define N_FLIP 2048          // 2^11 edge orientations
+#define N_SLICE 495          // 12 choose 4 positions of the UD-slice edges
+#define N_SLICE_SORTED 11880 // positions and order of the UD-slice edges
+#define N_PERM_4 24          // order of the UD-slice edges inside the slice
+#define N_CORNERS 40320      // 8! corner permutations
+#define N_UD_EDGES 40320     // 8! permutations of the U and D edges
+
+// -----------------------------------------------------------------------------
+
+// Coordinates of a cube state
+int twist_coord(const CubeState &state);
+int flip_coord(const CubeState &state);
+int slice_sorted_coord(const CubeState &state);
+int corners_coord(const CubeState &state);
+int ud_edges_coord(const CubeState &state);
+
+// Set the part of a state described by a coordinate, leaving the rest alone.
+// set_ud_edges puts the UD-slice edges back in the slice.
+void set_twist(CubeState &state, int twist);
+void set_flip(CubeState &state, int flip);
+void set_slice_sorted(CubeState &state, int idx);
+void set_corners(CubeState &state, int idx);
+void set_ud_edges(CubeState &state, int idx);
+
+// -----------------------------------------------------------------------------
+
+// Fill a move table [coordinate * NUM_MOVES + move] for the given moves by
+// applying them to a representative state of every coordinate
+void build_move_table(std::vector<uint16_t> &table, int size,
+	void (*set)(CubeState &, int), int (*get)(const CubeState &),
+	const int *moves, int num_moves);
+
+// Skip moves that are redundant after a move on last_face: the same face twice,
+// or two opposite faces in the non-canonical order
+inline bool redundant_face(int face, int last_face) {
+	return face == last_face || (face == (last_face ^ 1) && face < last_face);
+}
@@ -0,0 +1,172 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "cube_state.h"
+#include <cstring>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Clockwise quarter turn of each face, in the "replaced by" representation:
+// after the turn, slot i holds what was in slot cp[i], twisted by co[i]
+struct FaceTurn {
+	uint8_t cp[NUM_CORNERS];
+	uint8_t co[NUM_CORNERS];
+	uint8_t ep[NUM_EDGES];
+	uint8_t eo[NUM_EDGES];
+};
+
+const FaceTurn face_turns[6] = {
+	// Front
+	{{1, 5, 2, 3, 0, 4, 6, 7}, {1, 2, 0, 0, 2, 1, 0, 0},
+	 {0, 9, 2, 3, 4, 8, 6, 7, 1, 5, 10, 11}, {0, 1, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0}},
+	// Back
+	{{0, 1, 3, 7, 4, 5, 2, 6}, {0, 0, 1, 2, 0, 0, 2, 1},
+	 {0, 1, 2, 11, 4, 5, 6, 10, 8, 9, 3, 7}, {0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 1, 1}},
+	// Right
+	{{4, 1, 2, 0, 7, 5, 6, 3}, {2, 0, 0, 1, 1, 0, 0, 2},
+	 {8, 1, 2, 3, 11, 5, 6, 7, 4, 9, 10, 0}, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+	// Left
+	{{0, 2, 6, 3, 4, 1, 5, 7}, {0, 1, 2, 0, 0, 2, 1, 0},
+	 {0, 1, 10, 3, 4, 5, 9, 7, 8, 2, 6, 11}, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+	// Up
+	{{3, 0, 1, 2, 4, 5, 6, 7}, {0, 0, 0, 0, 0, 0, 0, 0},
+	 {3, 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11}, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+	// Down
+	{{0, 1, 2, 3, 5, 6, 7, 4}, {0, 0, 0, 0, 0, 0, 0, 0},
+	 {0, 1, 2, 3, 5, 6, 7, 4, 8, 9, 10, 11}, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+};
+
+// Outward normal of every face, the solved position of its center
+const int face_normals[6][3] = {
+	{0, 0, 1}, {0, 0, -1}, {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}
+};
+
+// Axes of the moves: F B R L U D, then M E S (which turn like L, D and F),
+// then x y z (which turn like R, U and F)
+const MoveAxis move_axes[NUM_AXES] = {
+	{FR, 1}, {BA, 1}, {RI, 1}, {LE, 1}, {UP, 1}, {DO, 1},
+	{LE, 2}, {DO, 2}, {FR, 2},
+	{RI, 7}, {UP, 7}, {FR, 7}
+};
+
+// Index of the slot whose solved position is p, or -1
+int find_slot(const int positions[][3], int count, const Eigen::Vector3i &p) {
+	for (int i = 0; i < count; i++) {
+		if (positions[i][0] == p(0) && positions[i][1] == p(1) && positions[i][2] == p(2)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CubeState::CubeState() {
+	for (int i = 0; i < NUM_CORNERS; i++) {
+		cp[i] = i;
+		co[i] = 0;
+	}
+	for (int i = 0; i < NUM_EDGES; i++) {
+		ep[i] = i;
+		eo[i] = 0;
+	}
+}
+
+void CubeState::turn(int face) {
+	const FaceTurn &m = face_turns[face];
+	uint8_t ncp[NUM_CORNERS], nco[NUM_CORNERS], nep[NUM_EDGES], neo[NUM_EDGES];
+	for (int i = 0; i < NUM_CORNERS; i++) {
+		ncp[i] = cp[m.cp[i]];
+		nco[i] = (co[m.cp[i]] + m.co[i]) % 3;
+	}
+	for (int i = 0; i < NUM_EDGES; i++) {
+		nep[i] = ep[m.ep[i]];
+		neo[i] = eo[m.ep[i]] ^ m.eo[i];
+	}
+	std::memcpy(cp, ncp, sizeof(cp));
+	std::memcpy(co, nco, sizeof(co));
+	std::memcpy(ep, nep, sizeof(ep));
+	std::memcpy(eo, neo, sizeof(eo));
+}
+
+void CubeState::move(int m) {
+	for (int t = 0; t <= m % 3; t++) {
+		turn(m / 3);
+	}
+}
+
+bool CubeState::is_solved() const {
+	for (int i = 0; i < NUM_CORNERS; i++) {
+		if (cp[i] != i || co[i] != 0) return false;
+	}
+	for (int i = 0; i < NUM_EDGES; i++) {
+		if (ep[i] != i || eo[i] != 0) return false;
+	}
+	return true;
+}
+
+bool CubeState::same_cubies(const CubeState &b) const {
+	for (int i = 0; i < NUM_CORNERS; i++) {
+		if (cp[i] != b.cp[i] || co[i] != b.co[i]) return false;
+	}
+	for (int i = 0; i < NUM_EDGES; i++) {
+		if (ep[i] != b.ep[i] || eo[i] != b.eo[i]) return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Eigen::Vector3i face_normal(int face) {
+	return Eigen::Vector3i(face_normals[face][0], face_normals[face][1], face_normals[face][2]);
+}
+
+Eigen::Matrix3i face_rotation(int face) {
+	Eigen::Vector3i n = face_normal(face);
+	Eigen::Matrix3i R;
+	for (int c = 0; c < 3; c++) {
+		Eigen::Vector3i v = Eigen::Vector3i::Unit(c);
+		R.col(c) = n * n.dot(v) - n.cross(v);
+	}
+	return R;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+OrientedState::OrientedState() : orientation(Eigen::Matrix3i::Identity()) { }
+
+void OrientedState::move(int m) {
+	MoveAxis axis = move_axis(m);
+	int turns = m % 3 + 1;
+	int face = state_face(axis.face);
+	int opposite = face ^ 1;
+	if (axis.layers & 2) {
+		// Turning the middle layer is turning the whole puzzle, then turning
+		// back the outer layers that stay
+		if (!(axis.layers & 1)) state.move(face * 3 + 3 - turns);
+		if (!(axis.layers & 4)) state.move(opposite * 3 + turns - 1);
+		for (int t = 0; t < turns; t++) {
+			orientation = face_rotation(axis.face) * orientation;
+		}
+	}
+	else {
+		// The opposite layer turns the other way around its own normal
+		if (axis.layers & 1) state.move(face * 3 + turns - 1);
+		if (axis.layers & 4) state.move(opposite * 3 + 3 - turns);
+	}
+}
+
+int OrientedState::state_face(int world_face) const {
+	Eigen::Vector3i n = orientation.transpose() * face_normal(world_face);
+	return find_slot(face_normals, NUM_CENTERS, n);
+}
+
+int OrientedState::world_face(int state_face) const {
+	Eigen::Vector3i n = orientation * face_normal(state_face);
+	return find_slot(face_normals, NUM_CENTERS, n);
+}
+
+MoveAxis move_axis(int m) {
+	return move_axes[m / 3];
+}
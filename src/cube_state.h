@@ -0,0 +1,95 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include <Eigen/Dense>
+#include <cstdint>
+////////////////////////////////////////////////////////////////////////////////
+
+// Corner slots:  URF, UFL, ULB, UBR, DFR, DLF, DBL, DRB
+// Edge slots:    UR, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR
+// Center slots:  front, back, right, left, up, down (same order as the faces)
+//
+// Axes follow the scene: x points right, y points up and z points to the front.
+
+#define FR 0
+#define BA 1
+#define RI 2
+#define LE 3
+#define UP 4
+#define DO 5
+
+#define NUM_CORNERS 8
+#define NUM_EDGES 12
+#define NUM_CENTERS 6
+
+// Face turn moves are numbered face * 3 + (quarter turns - 1), e.g. R2 = RI * 3 + 1
+#define NUM_MOVES 18
+
+// The moves of the viewer and the notation add slice moves (M, E, S) and
+// whole cube rotations (x, y, z), numbered after the face turns the same
+// way: axis * 3 + (quarter turns - 1), see move_axis()
+#define NUM_AXES 12
+#define NUM_ALL_MOVES (NUM_AXES * 3)
+
+// -----------------------------------------------------------------------------
+
+// State of a 3x3x3 cube at the cubie level. Every array is indexed by slot and
+// stores which cubie currently sits there ("replaced by" representation).
+struct CubeState {
+	uint8_t cp[NUM_CORNERS]; // corner permutation
+	uint8_t co[NUM_CORNERS]; // corner orientation (0..2, clockwise twists)
+	uint8_t ep[NUM_EDGES];   // edge permutation
+	uint8_t eo[NUM_EDGES];   // edge orientation (0..1)
+
+	// A solved cube
+	CubeState();
+
+	// Apply a single clockwise quarter turn of a face
+	void turn(int face);
+
+	// Apply a face turn move (0-17)
+	void move(int m);
+
+	// True if every corner and edge is home
+	bool is_solved() const;
+
+	// True if both states place the corners and edges alike
+	bool same_cubies(const CubeState &b) const;
+};
+
+// Layers turned by the moves of an axis, clockwise around the outward normal
+// of 'face'. Bit 0 is the layer of the face, bit 1 the middle layer and bit 2
+// the opposite layer.
+struct MoveAxis {
+	int face;
+	int layers;
+};
+
+// A cube state with the rotation of the whole puzzle. The centers of a
+// CubeState never move, so slice moves and cube rotations turn the frame
+// instead: M is played as R L' x'. Moves name faces in the world frame.
+struct OrientedState {
+	CubeState state;
+	Eigen::Matrix3i orientation; // puzzle frame to world frame
+
+	// A solved cube, not rotated
+	OrientedState();
+
+	// Apply a move (0 to NUM_ALL_MOVES - 1)
+	void move(int m);
+
+	// Face of the cube state under a face of the world, and back
+	int state_face(int world_face) const;
+	int world_face(int state_face) const;
+};
+
+// -----------------------------------------------------------------------------
+
+// Layers turned by a move
+MoveAxis move_axis(int m);
+
+// Outward normal of a face (FR, BA, RI, LE, UP, DO)
+Eigen::Vector3i face_normal(int face);
+
+// Clockwise quarter turn around the outward normal of a face
+Eigen::Matrix3i face_rotation(int face);
@@ -0,0 +1,344 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "frame_export.h"
+#include "helpers.h"
+#include "image.h"
+#include "trace.h"
+#ifdef RUBIK_PNG
+#include <zlib.h>
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+////////////////////////////////////////////////////////////////////////////////
+
+struct FrameExporter::Output {
+	std::string path;
+	FrameFormat format;
+	bool single_frame;
+
+	// Y4M only: the stream and the encoded frames waiting for the ones
+	// before them, as they are encoded out of order
+	std::mutex mutex;
+	std::ofstream stream;
+	std::map<int, Frame *> ready;
+	int written = 0;
+};
+
+struct FrameExporter::Frame {
+	std::shared_ptr<Output> output;
+	int index;
+	int width;
+	int height;
+	std::vector<unsigned char> rgb; // top row first
+	std::vector<unsigned char> yuv; // Y, then U and V at half resolution
+};
+
+namespace {
+
+// Limited range BT.601, chroma averaged over blocks of 2 x 2 pixels
+void rgb_to_yuv420(const unsigned char *rgb, int width, int height, std::vector<unsigned char> &yuv) {
+	int chroma_width = (width + 1) / 2;
+	int chroma_height = (height + 1) / 2;
+	yuv.resize(width * height + 2 * chroma_width * chroma_height);
+	unsigned char *y_plane = yuv.data();
+	unsigned char *u_plane = y_plane + width * height;
+	unsigned char *v_plane = u_plane + chroma_width * chroma_height;
+	for (int i = 0; i < width * height; i++) {
+		int r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+		y_plane[i] = (unsigned char) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	}
+	for (int cy = 0; cy < chroma_height; cy++) {
+		for (int cx = 0; cx < chroma_width; cx++) {
+			int r = 0, g = 0, b = 0;
+			for (int k = 0; k < 4; k++) {
+				// The last row and column are repeated on odd sizes
+				int x = std::min(2 * cx + k % 2, width - 1);
+				int y = std::min(2 * cy + k / 2, height - 1);
+				const unsigned char *p = rgb + 3 * (y * width + x);
+				r += p[0];
+				g += p[1];
+				b += p[2];
+			}
+			r /= 4;
+			g /= 4;
+			b /= 4;
+			u_plane[cy * chroma_width + cx] = (unsigned char) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			v_plane[cy * chroma_width + cx] = (unsigned char) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+	}
+}
+
+#ifdef RUBIK_PNG
+void write_uint32(std::ostream &out, uint32_t value) {
+	const char bytes[4] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+	out.write(bytes, 4);
+}
+
+void write_chunk(std::ostream &out, const char *type, const unsigned char *data, size_t size) {
+	write_uint32(out, (uint32_t) size);
+	out.write(type, 4);
+	out.write(reinterpret_cast<const char *>(data), size);
+	// The CRC covers the type and the data; crc32() restarts on a null buffer
+	uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+	if (size > 0) crc = crc32(crc, data, (uInt) size);
+	write_uint32(out, (uint32_t) crc);
+}
+#endif
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool parse_frame_format(const std::string &name, FrameFormat &format) {
+	if (name == "ppm") format = FRAME_PPM;
+#ifdef RUBIK_PNG
+	else if (name == "png") format = FRAME_PNG;
+#endif
+	else if (name == "y4m") format = FRAME_Y4M;
+	else return false;
+	return true;
+}
+
+#ifdef RUBIK_PNG
+bool save_png(const std::string &fname, int width, int height, const unsigned char *rgb) {
+	// Every row is stored as its difference with the row above (filter "Up"),
+	// which leaves mostly zeros on flat shaded renders
+	size_t row = 3 * width;
+	std::vector<unsigned char> filtered((row + 1) * height);
+	for (int y = 0; y < height; y++) {
+		unsigned char *out = &filtered[y * (row + 1)];
+		const unsigned char *in = rgb + y * row;
+		out[0] = 2;
+		for (size_t x = 0; x < row; x++) {
+			out[x + 1] = (unsigned char) (in[x] - (y > 0 ? in[x - row] : 0));
+		}
+	}
+	uLongf compressed_size = compressBound(filtered.size());
+	std::vector<unsigned char> compressed(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, filtered.data(), filtered.size(), Z_BEST_SPEED) != Z_OK) {
+		return false;
+	}
+
+	std::ofstream file(fname, std::ios::binary);
+	if (!file.is_open()) return false;
+	const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	file.write(reinterpret_cast<const char *>(signature), 8);
+	// Size, 8 bits per channel, RGB, default compression, filters and no interlacing
+	unsigned char header[13] = {
+		(unsigned char) (width >> 24), (unsigned char) (width >> 16), (unsigned char) (width >> 8), (unsigned char) width,
+		(unsigned char) (height >> 24), (unsigned char) (height >> 16), (unsigned char) (height >> 8), (unsigned char) height,
+		8, 2, 0, 0, 0};
+	write_chunk(file, "IHDR", header, sizeof(header));
+	write_chunk(file, "IDAT", compressed.data(), compressed_size);
+	write_chunk(file, "IEND", NULL, 0);
+	return file.good();
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+FrameExporter::FrameExporter()
+	: width(0), height(0), next_slot(0), frame_index(0), pool(NULL), pending(0), max_pending(0), failed(false)
+{ }
+
+FrameExporter::~FrameExporter() {
+	free();
+}
+
+void FrameExporter::init(const OffscreenTarget &target, int num_slots, int threads) {
+	width = target.width;
+	height = target.height;
+	slots.resize(std::max(1, num_slots));
+	for (Slot &slot : slots) {
+		glGenBuffers(1, &slot.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, 3 * width * height, NULL, GL_STREAM_READ);
+		slot.fence = 0;
+		slot.index = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	check_gl_error();
+	next_slot = 0;
+
+	threads = std::max(1, threads);
+	pool = new Eigen::NonBlockingThreadPool(threads);
+	max_pending = 2 * threads;
+}
+
+bool FrameExporter::begin(const std::string &path, FrameFormat format, int fps, bool single_frame) {
+	end();
+	output = std::make_shared<Output>();
+	output->path = path;
+	output->format = format;
+	output->single_frame = single_frame;
+	frame_index = 0;
+	if (format != FRAME_Y4M) return true;
+
+	// A still image has no rate, a frame per second is the nominal one
+	if (fps < 1) fps = 1;
+	output->stream.open(path + ".y4m", std::ios::binary);
+	output->stream << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+	if (!output->stream.good()) {
+		output.reset();
+		return false;
+	}
+	return true;
+}
+
+void FrameExporter::capture(OffscreenTarget &target) {
+	if (!output) return;
+	Slot &slot = slots[next_slot];
+	next_slot = (next_slot + 1) % slots.size();
+	if (slot.fence) retire(slot);
+
+	// Asynchronous read: glReadPixels returns at once when packing into a PBO
+	target.resolve();
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.output = output;
+	slot.index = frame_index++;
+	check_gl_error();
+}
+
+void FrameExporter::end() {
+	// Oldest first, so the frames of a stream reach the encoders in order
+	for (size_t i = 0; i < slots.size(); i++) {
+		Slot &slot = slots[(next_slot + i) % slots.size()];
+		if (slot.fence) retire(slot);
+	}
+	output.reset();
+}
+
+bool FrameExporter::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	encoded.wait(lock, [&]() { return pending == 0; });
+	bool ok = !failed;
+	failed = false;
+	return ok;
+}
+
+void FrameExporter::free() {
+	if (!pool) return;
+	end();
+	wait();
+	delete pool;
+	pool = NULL;
+	for (Slot &slot : slots) {
+		glDeleteBuffers(1, &slot.pbo);
+	}
+	slots.clear();
+	free_frames.clear();
+}
+
+void FrameExporter::retire(Slot &slot) {
+	TRACE_SCOPE("frame_readback");
+	while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED) { }
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	// Wait for the encoders when they fall behind, then take a recycled frame
+	std::unique_ptr<Frame> frame;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		encoded.wait(lock, [&]() { return pending < max_pending; });
+		pending++;
+		if (!free_frames.empty()) {
+			frame = std::move(free_frames.back());
+			free_frames.pop_back();
+		}
+	}
+	if (!frame) frame.reset(new Frame);
+	frame->output = std::move(slot.output);
+	frame->index = slot.index;
+	frame->width = width;
+	frame->height = height;
+
+	// Rows come bottom first
+	size_t row = 3 * width;
+	frame->rgb.resize(row * height);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	const unsigned char *mapped = (const unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row * height, GL_MAP_READ_BIT);
+	if (mapped) {
+		for (int y = 0; y < height; y++) {
+			memcpy(&frame->rgb[(height - 1 - y) * row], mapped + y * row, row);
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		std::fill(frame->rgb.begin(), frame->rgb.end(), 0);
+		std::lock_guard<std::mutex> lock(mutex);
+		failed = true;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	Frame *encoding = frame.release();
+	pool->Schedule([this, encoding]() { encode(encoding); });
+}
+
+void FrameExporter::encode(Frame *frame) {
+	TRACE_SCOPE("frame_encode");
+	Output &out = *frame->output;
+	char suffix[16] = "";
+	if (!out.single_frame) snprintf(suffix, sizeof(suffix), "_%06d", frame->index + 1);
+	bool ok = true;
+	switch (out.format) {
+		case FRAME_PPM:
+			ok = save_ppm(out.path + suffix + ".ppm", frame->width, frame->height, frame->rgb.data());
+			break;
+		case FRAME_PNG:
+#ifdef RUBIK_PNG
+			ok = save_png(out.path + suffix + ".png", frame->width, frame->height, frame->rgb.data());
+#else
+			ok = false;
+#endif
+			break;
+		case FRAME_Y4M:
+			rgb_to_yuv420(frame->rgb.data(), frame->width, frame->height, frame->yuv);
+			write_stream(out, frame);
+			return;
+	}
+
+	frame->output.reset();
+	std::lock_guard<std::mutex> lock(mutex);
+	free_frames.push_back(std::unique_ptr<Frame>(frame));
+	failed = failed || !ok;
+	pending--;
+	encoded.notify_all();
+}
+
+void FrameExporter::write_stream(Output &out, Frame *frame) {
+	// Whoever encodes the next frame in order writes it, along with the
+	// encoded frames that follow it
+	std::vector<Frame *> written;
+	bool ok = true;
+	{
+		std::lock_guard<std::mutex> lock(out.mutex);
+		out.ready[frame->index] = frame;
+		while (!out.ready.empty() && out.ready.begin()->first == out.written) {
+			Frame *next = out.ready.begin()->second;
+			out.ready.erase(out.ready.begin());
+			out.stream << "FRAME\n";
+			out.stream.write(reinterpret_cast<const char *>(next->yuv.data()), next->yuv.size());
+			ok = ok && out.stream.good();
+			out.written++;
+			written.push_back(next);
+		}
+	}
+
+	// The last frame of the stream closes it
+	for (Frame *done : written) {
+		done->output.reset();
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	for (Frame *done : written) {
+		free_frames.push_back(std::unique_ptr<Frame>(done));
+		pending--;
+	}
+	failed = failed || !ok;
+	encoded.notify_all();
+}
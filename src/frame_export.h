@@ -0,0 +1,97 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "offscreen.h"
+#include <unsupported/Eigen/CXX11/ThreadPool>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Frames of an OffscreenTarget written to disk without stalling the GL
+// pipeline: every frame is copied into the next pixel buffer object of a
+// ring, and only mapped once the ring comes back to it, a few frames later.
+// The pixels are then encoded and written on a thread pool.
+
+enum FrameFormat {
+	FRAME_PPM, // binary PPM, one file per frame
+	FRAME_PNG, // PNG, one file per frame (needs zlib)
+	FRAME_Y4M, // YUV4MPEG2 stream of all the frames, 4:2:0
+};
+
+// Parse "ppm", "png" or "y4m", false if unknown or not built
+bool parse_frame_format(const std::string &name, FrameFormat &format);
+
+// Write 8-bit RGB pixels, top row first, as a PNG file
+bool save_png(const std::string &fname, int width, int height, const unsigned char *rgb);
+
+// -----------------------------------------------------------------------------
+
+class FrameExporter {
+public:
+	FrameExporter();
+	~FrameExporter();
+
+	// Create 'slots' pixel buffers for frames of the size of the target and
+	// 'threads' encoders
+	void init(const OffscreenTarget &target, int slots, int threads);
+
+	// Start an output: 'path'_NNNNNN.ext files for PPM and PNG, 'path'.y4m
+	// for Y4M, played at 'fps'. A single frame is written to 'path'.ext, or
+	// to a Y4M stream at 1 fps.
+	// False if the file cannot be created.
+	bool begin(const std::string &path, FrameFormat format, int fps, bool single_frame = false);
+
+	// Resolve the target and start copying it into the ring, the oldest frame
+	// in the ring goes to the encoders
+	void capture(OffscreenTarget &target);
+
+	// End the output: the frames left in the ring go to the encoders
+	void end();
+
+	// Wait until every frame is written, false if a write failed since the
+	// last call
+	bool wait();
+
+	// Release the pixel buffers and stop the encoders
+	void free();
+
+private:
+	struct Output;
+	struct Frame;
+	struct Slot {
+		GLuint pbo;
+		GLsync fence;
+		std::shared_ptr<Output> output;
+		int index;
+	};
+
+	// Map the pixels of a slot and schedule their encoding
+	void retire(Slot &slot);
+
+	// Encode a frame and write it, then recycle its buffers
+	void encode(Frame *frame);
+
+	// Write the frames of a Y4M stream that are next in order
+	void write_stream(Output &output, Frame *frame);
+
+	int width;
+	int height;
+	std::vector<Slot> slots;
+	size_t next_slot;
+	std::shared_ptr<Output> output;
+	int frame_index;
+	Eigen::NonBlockingThreadPool *pool;
+
+	// Frames being encoded, bounded so that the renderer cannot run too far
+	// ahead, and their recycled buffers
+	std::mutex mutex;
+	std::condition_variable encoded;
+	int pending;
+	int max_pending;
+	std::vector<std::unique_ptr<Frame> > free_frames;
+	bool failed;
+};
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+// Solvers
+#include "two_phase.h"
+#include "optimal.h"
+// STL headers
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+////////////////////////////////////////////////////////////////////////////////
+
+// Builds the pruning tables of both solvers offline, so the viewer only maps
+// them from disk.
+//
+// Usage: generate_tables [output directory] [threads]
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool save(const PatternDatabase &pdb, const std::string &path) {
+	if (!pdb.save(path)) {
+		std::cerr << "Could not write " << path << std::endl;
+		return false;
+	}
+	std::cout << "Wrote " << path << std::endl;
+	return true;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	std::string dir = argc > 1 ? argv[1] : DATA_DIR "tables";
+	int num_threads = argc > 2 ? atoi(argv[2]) : 0;
+	if (num_threads <= 0) {
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	mkdir(dir.c_str(), 0755);
+
+	// Two-phase pruning tables, a second at most
+	Clock::time_point start = Clock::now();
+	TwoPhaseSolver two_phase;
+	two_phase.build_move_tables();
+	two_phase.generate_prune_tables();
+	if (!two_phase.save(dir)) {
+		std::cerr << "Could not write the two-phase tables to " << dir << std::endl;
+		return 1;
+	}
+	std::cout << "Two-phase tables: " << seconds_since(start) << "s" << std::endl;
+
+	// Pattern databases of the optimal solver
+	Eigen::NonBlockingThreadPool pool(num_threads);
+	PatternDatabase pdb;
+
+	start = Clock::now();
+	generate_corner_pdb(pdb, pool);
+	if (!save(pdb, dir + "/" + corner_pdb_file)) return 1;
+	std::cout << "Corner database: " << seconds_since(start) << "s" << std::endl;
+
+	for (int g = 0; g < 2; g++) {
+		start = Clock::now();
+		generate_edge_pdb(pdb, g, pool);
+		if (!save(pdb, dir + "/" + edge_pdb_files[g])) return 1;
+		std::cout << "Edge database " << g << ": " << seconds_since(start) << "s" << std::endl;
+	}
+	return 0;
+}
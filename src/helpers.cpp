@@ -4,9 +4,10 @@
 #include <fstream>
 ////////////////////////////////////////////////////////////////////////////////
 
-void VertexBufferObject::init(GLenum st, GLenum bt) {
+void VertexBufferObject::init(GLenum st, GLenum bt, GLenum u) {
 	scalar_type = st;
 	buffer_type = bt;
+	usage = u;
 	glGenBuffers(1, &id);
 	check_gl_error();
 }
@@ -100,6 +101,10 @@ GLint Program::uniform(const std::string &name) const {
 	return glGetUniformLocation(program_shader, name.c_str());
 }
 
+GLint Program::uniform(const char *name) const {
+	return glGetUniformLocation(program_shader, name);
+}
+
 GLint Program::bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO) const {
 	GLint id = attrib(name);
 	if (id < 0) {
@@ -117,6 +122,25 @@ GLint Program::bindVertexAttribArray(const std::string &name, VertexBufferObject
 	return id;
 }
 
+GLint Program::bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO, int size, int first) const {
+	GLint id = attrib(name);
+	if (id < 0) {
+		return id;
+	}
+	if (VBO.id == 0) {
+		glDisableVertexAttribArray(id);
+		return id;
+	}
+	// Columns are stored one after the other, 4 bytes per scalar
+	GLsizei stride = VBO.rows * 4;
+	VBO.bind();
+	glEnableVertexAttribArray(id);
+	glVertexAttribPointer(id, size, VBO.scalar_type, GL_FALSE, stride, (const GLvoid *) (size_t) (first * 4));
+	check_gl_error();
+
+	return id;
+}
+
 void Program::free() {
 	if (program_shader) {
 		glDeleteProgram(program_shader);
@@ -21,13 +21,14 @@ public:
 	GLuint cols;
 	GLenum scalar_type; // scalar type stored in the VBO
 	GLenum buffer_type; // buffer type, see http://docs.gl/gl3/glBindBuffer
+	GLenum usage; // GL_STATIC_DRAW for data uploaded once, see http://docs.gl/gl3/glBufferData
 
 	VertexBufferObject()
-		: id(0), rows(0), cols(0), scalar_type(GL_FLOAT), buffer_type(GL_ARRAY_BUFFER)
+		: id(0), rows(0), cols(0), scalar_type(GL_FLOAT), buffer_type(GL_ARRAY_BUFFER), usage(GL_DYNAMIC_DRAW)
 	{ }
 
 	// Create a new empty VBO
-	void init(GLenum st, GLenum bt);
+	void init(GLenum st, GLenum bt, GLenum u = GL_DYNAMIC_DRAW);
 
 	// Updates the VBO with a matrix M
 	template<typename Derived>
@@ -94,10 +95,15 @@ public:
 
 	// Return the OpenGL handle of a uniform attribute (-1 if it does not exist)
 	GLint uniform(const std::string &name) const;
+	GLint uniform(const char *name) const;
 
 	// Bind a per-vertex array attribute
 	GLint bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO) const;
 
+	// Bind a per-vertex attribute interleaved with others: rows first to
+	// size + first rows of every column of the VBO
+	GLint bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO, int size, int first) const;
+
 	GLuint create_shader_helper(GLint type, const std::string &shader_string);
 };
 
@@ -131,7 +137,13 @@ void VertexBufferObject::update(const Eigen::PlainObjectBase<Derived>& M) {
 	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &current_vao);
 	glBindVertexArray(0); // Make sure to not affect the current VAO
 	glBindBuffer(this->buffer_type, id);
-	glBufferData(this->buffer_type, sizeof(typename Derived::Scalar)*M.size(), M.data(), GL_DYNAMIC_DRAW);
+	if (M.rows() == rows && M.cols() == cols) {
+		// Same size: overwrite the storage instead of allocating a new one
+		glBufferSubData(this->buffer_type, 0, sizeof(typename Derived::Scalar)*M.size(), M.data());
+	}
+	else {
+		glBufferData(this->buffer_type, sizeof(typename Derived::Scalar)*M.size(), M.data(), usage);
+	}
 	glBindBuffer(this->buffer_type, 0);
 	rows = M.rows();
 	cols = M.cols();
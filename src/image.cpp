@@ -1,5 +1,6 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include "image.h"
+#include "trace.h"
 // stb_image for loading textures
 #define STB_IMAGE_IMPLEMENTATION // Do not include this line twice in your project!
 #include "stb_image.h"
@@ -7,6 +8,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 bool load_image(const std::string &fname, Image & pixels) {
+	TRACE_SCOPE("load_image");
 	int width, height, num_raw_channels;
 	unsigned char *data = stbi_load(fname.c_str(), &width, &height, &num_raw_channels, 4);
 
@@ -26,6 +28,14 @@ bool load_image(const std::string &fname, Image & pixels) {
 	return true;
 }
 
+bool save_ppm(const std::string &fname, int width, int height, const unsigned char *rgb) {
+	std::ofstream file(fname, std::ios::binary);
+	if (!file.is_open()) return false;
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write(reinterpret_cast<const char *>(rgb), 3 * width * height);
+	return file.good();
+}
+
 std::string load_text(const std::string &fname) {
 	std::ifstream file(fname);
 	if (file.is_open()) {
@@ -10,5 +10,8 @@ typedef Eigen::Matrix<Pixel, Eigen::Dynamic, Eigen::Dynamic> Image;
 // Load an image from a file
 bool load_image(const std::string &fname, Image & pixels);
 
+// Write 8-bit RGB pixels, top row first, as a binary PPM file
+bool save_ppm(const std::string &fname, int width, int height, const unsigned char *rgb);
+
 // Load text from a file
 std::string load_text(const std::string &fname);
\ No newline at end of file
@@ -2,7 +2,23 @@
 // OpenGL Helpers to reduce the clutter
 #include "helpers.h"
 #include "image.cpp"
+// Cubie-level cube state and the cubes derived from it
+#include "cube_state.h"
+#include "scene.h"
+// Solvers
+#include "two_phase.h"
+#include "optimal.h"
+#include "solve_job.h"
+#include "notation.h"
+#include "trace.h"
 #include <fstream>
+#ifdef RUBIK_COUNT_ALLOCATIONS
+#include "allocation_counter.h"
+#endif
+#ifdef RUBIK_HEADLESS
+#include "offscreen.h"
+#include "frame_export.h"
+#endif
 // GLFW is necessary to handle the OpenGL context
 #include <GLFW/glfw3.h>
 // Linear Algebra Library
@@ -10,125 +26,129 @@
 #include <Eigen/Geometry>
 // STL headers
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
-#include <queue>
-#include <stack>
+#include <string>
+#include <thread>
 ////////////////////////////////////////////////////////////////////////////////
 
-#define FR 0
-#define BA 1
-#define RI 2
-#define LE 3
-#define UP 4
-#define DO 5
+// The central cube, uploaded once and drawn for every cube with instancing
+struct CubeMesh {
+	Eigen::MatrixXf V; // mesh vertices [3 x 36]
+	Eigen::MatrixXf UV; // position inside a sticker tile [2 x 36]
+	Eigen::MatrixXf FACE; // face of each vertex [1 x 36]
+	Eigen::MatrixXi F; // mesh triangles [3 x 12]
 
-#define FRAME_NUM 24
+	// V, UV and FACE stacked, so the attributes of a vertex are side by side
+	// in a single buffer [6 x 36]
+	Eigen::MatrixXf VERTICES;
 
-// Cube object, with both CPU data (Eigen::Matrix) and GPU data (the VBOs)
-struct Cube {
-	Eigen::MatrixXf V; // mesh vertices [3 x n]
-	Eigen::MatrixXf C; // mesh color [3 x n]
-	Eigen::MatrixXf TX; // mesh texture [2 x n]
-	Eigen::MatrixXi F; // mesh triangles [3 x m]
-
-	// VBO storing vertex position attributes
-	VertexBufferObject V_vbo;
+	// Static VBO storing the interleaved vertex attributes
+	VertexBufferObject VERTICES_vbo;
 
 	// VBO storing vertex indices (element buffer)
 	VertexBufferObject F_vbo;
 
-	// VBO storing colors
-	VertexBufferObject C_vbo;
-
-	// VBO storing textures
-	VertexBufferObject T_vbo;
-
-	// VAO storing the layout of the shader program for the object 'bunny'
+	// VAO storing the layout of the shader program for the mesh
 	VertexArrayObject vao;
-
-	// The transform matrix
-	Eigen::MatrixXf T;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
 /*** Global variables declaration ***/
 
-// A 3d array storing all the cubes in the scene
-std::vector<Cube> cubes;
+// Layers along each axis of the puzzle, set with --size
+int puzzle_size = 3;
+
+// File the trace is written to, set with --trace or on the first T
+std::string trace_path;
+
+// The surface cubes of the puzzle
+CubeList cubes;
 
-// 6 unordered-sets storing the cubes on 6 faces; 
-std::unordered_set<int> right_faces;
-std::unordered_set<int> left_faces;
-std::unordered_set<int> front_faces;
-std::unordered_set<int> back_faces;
-std::unordered_set<int> up_faces;
-std::unordered_set<int> down_faces;
+// The mesh shared by all the cubes
+CubeMesh mesh;
 
-// A vector storing the frames (defferent view matrix) needed to play the animation
-std::vector<Eigen::Matrix4f> frames;
+// Per-instance data read by the vertex shader, 6 columns per cube:
+// the model matrix followed by the sticker tiles of the 6 faces
+Eigen::MatrixXf instances;
 
-// A frame counter to control the animation play
-int frame_cnt = -1;
+// Texture buffer exposing the instance data to the vertex shader
+VertexBufferObject instance_vbo;
+GLuint instance_texture = 0;
 
-// Save the current time --- it will be used to control the animation
-auto t_start = std::chrono::high_resolution_clock::now();
+// Each face of the mesh is drawn on the cubes where it can be seen (see
+// Cube::exposed): face f on the cubes face_cubes[face_offsets[f]] up to
+// face_cubes[face_offsets[f + 1] - 1]
+Eigen::VectorXi face_cubes;
+int face_offsets[7] = {0};
+VertexBufferObject face_cubes_vbo;
+GLuint face_cubes_texture = 0;
 
-// Rotation option
-int rotation_option = -1;
+// The cubie-level state of the puzzle and its orientation, followed by the
+// solvers. It only describes a 3x3x3 puzzle.
+OrientedState cube_state;
 
-// Rotation options
-std::queue<int> rotation_options;
-std::queue<int> rotation_started;
+// Solver used by the SPACE key, its tables are built on first use
+TwoPhaseSolver solver;
 
-std::stack<int> rotation_reversed;
+// Optimal solver used by the O key, its databases are mapped on first use
+OptimalSolver optimal_solver;
+
+// Solve running in the background, at most one at a time
+SolveJob solve_job;
+
+// Depth shown in the window title while solving
+int shown_depth = -1;
+
+// The queued moves and the turns being played, drawn by the vertex shader
+// from the start transforms. Quarter turns take player.duration seconds,
+// changed with the - and = keys.
+TurnPlayer player;
 
 // The id of the selected object
 int selected_obj = -1;
 
+// Set when the scene changed and the window needs a new frame; while a turn
+// plays frames are drawn anyway
+bool redraw = true;
+
 // The view matrix
-Eigen::MatrixXf view = Eigen::Matrix4f::Identity();
+Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
 
 // Projection matrix
-Eigen::MatrixXf proj = Eigen::Matrix4f::Identity();
-
-void rotate_front();
-void rotate_back();
-void rotate_right();
-void rotate_left();
-void rotate_up();
-void rotate_down();
-void rotate_front_ccw();
-void rotate_back_ccw();
-void rotate_right_ccw();
-void rotate_left_ccw();
-void rotate_up_ccw();
-void rotate_down_ccw();
+Eigen::Matrix4f proj = Eigen::Matrix4f::Identity();
+
+#ifdef RUBIK_COUNT_ALLOCATIONS
+// Iterations of the main loop, and those that allocated after the first one
+int frames = 0;
+int frames_allocating = 0;
+#endif
+
+void update_instances();
+void update_face_cubes();
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void key_callback_LEFT_SHIFT(GLFWwindow* window, int key, int scancode, int action, int mods);
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Check whether a cube currently sits on a face
+bool on_face(int c, int face) {
+	return cube_on_face(cubes[c], face, puzzle_size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 // Create a cube and initialize all the parameters
 void reset_cubes() {
 	cubes.clear();
-	right_faces.clear();
-	left_faces.clear();
-	front_faces.clear();
-	back_faces.clear();
-	up_faces.clear();
-	down_faces.clear();
-	frames.clear();
-	frame_cnt = -1;
-	t_start = std::chrono::high_resolution_clock::now();
-	int rotation_option = -1;
-	rotation_options = std::queue<int>();
-	rotation_started = std::queue<int>();
-	rotation_reversed = std::stack<int>();
+	cube_state = OrientedState();
+	player.clear();
 
 	// Reset view matrix
 	view = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/4.0, Eigen::Vector3f::UnitX())).matrix() * 
@@ -140,652 +160,261 @@ void reset_cubes() {
 		0, 0, -1, 0,
 		0, 0, 0, 1;
 
-	/*** Create the central cube first ***/
-	// Construct 6 faces for the central cube
-	Eigen::MatrixXf front(3, 6);
-	front << 
-		0.15, 0.15, -0.15, 0.15, -0.15, -0.15, 
-		0.15, -0.15, -0.15, 0.15, 0.15, -0.15,
-		0.15, 0.15, 0.15, 0.15, 0.15, 0.15;
+	// Construct all the cubes from the central cube
+	build_cubes(puzzle_size, cubes);
+	update_instances();
+	update_face_cubes();
+	redraw = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
 
-	Eigen::MatrixXf back(3, 6);
-	for (int c = 0; c < 6; c++) {
-		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI, Eigen::Vector3f::UnitX())).matrix() * 
-								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
-		back.col(c) << v(0), v(1), v(2);
+// Model matrix of a cube for the vertex shaders, read from the instance buffer.
+// The cubes of the turning layers are rotated here, so a turn only changes the
+// turn_angle uniform from frame to frame. Up to 2 turns play at once, on
+// disjoint layers.
+//
+// Every face of the mesh is drawn by its own instanced call, on the cubes
+// where it can be seen at all, so most black faces never reach the vertex
+// shader. The black faces drawn are pressed against a neighbour until a turn
+// separates the two cubes and opens a gap between them; until then they
+// collapse to a point here, which saves their fill but not their vertices.
+const GLchar* instance_model_shader = R"(
+	uniform samplerBuffer instances;
+
+	// Cubes of the face being drawn, from face_offset on
+	uniform isamplerBuffer face_cubes;
+	uniform int face_offset;
+
+	uniform vec3 turn_axis[2];
+	uniform vec2 turn_layer[2]; // range of the cube centers along the axis
+	uniform float turn_angle[2];
+
+	const vec3 face_normals[6] = vec3[6](
+		vec3(0, 0, 1), vec3(0, 0, -1), vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0));
+
+	// Cube of the instance
+	int instance_cube() {
+		return texelFetch(face_cubes, face_offset + gl_InstanceID).r;
 	}
 
-	Eigen::MatrixXf right(3, 6);
-	for (int c = 0; c < 6; c++) {
-		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2, Eigen::Vector3f::UnitY())).matrix() * 
-								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
-		right.col(c) << v(0), v(1), v(2);
+	// Model matrix before the turns: the transform of the cube followed by its
+	// position in the solved puzzle
+	mat4 instance_rest_model() {
+		int base = instance_cube() * 6;
+		return mat4(
+			texelFetch(instances, base),
+			texelFetch(instances, base + 1),
+			texelFetch(instances, base + 2),
+			texelFetch(instances, base + 3));
 	}
 
-	Eigen::MatrixXf left(3, 6);
-	for (int c = 0; c < 6; c++) {
-		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2, Eigen::Vector3f::UnitY())).matrix() * 
-								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
-		left.col(c) << v(0), v(1), v(2);
+	// Sticker tile of a face of the cube, negative for black plastic
+	float instance_tile(int face) {
+		int base = instance_cube() * 6;
+		return face < 4 ? texelFetch(instances, base + 4)[face] : texelFetch(instances, base + 5)[face - 4];
 	}
 
-	Eigen::MatrixXf up(3, 6);
-	for (int c = 0; c < 6; c++) {
-		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2, Eigen::Vector3f::UnitX())).matrix() * 
-								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
-		up.col(c) << v(0), v(1), v(2);
+	// Turn moving the cube centered at p, -1 if none
+	int turn_of(vec3 p) {
+		for (int i = 0; i < 2; i++) {
+			float d = dot(p, turn_axis[i]);
+			if (d >= turn_layer[i].x && d <= turn_layer[i].y) return i;
+		}
+		return -1;
 	}
 
-	Eigen::MatrixXf down(3, 6);
-	for (int c = 0; c < 6; c++) {
-		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2, Eigen::Vector3f::UnitX())).matrix() * 
-								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
-		down.col(c) << v(0), v(1), v(2);
+	bool face_visible(int face) {
+		if (instance_tile(face) >= 0.0) return true;
+		// The model scales the unit cube, so the neighbour is 2 normals away
+		mat4 model = instance_rest_model();
+		vec3 neighbour = model[3].xyz + 2.0 * mat3(model) * face_normals[face];
+		return turn_of(model[3].xyz) != turn_of(neighbour);
 	}
 
-	// Create the central cube
-	Cube center;
-	center.V.resize(3, 36);
-	center.F.resize(3, 12);
-	for (int c = 0; c < 6; c++) {
-		center.V.col(c) = front.col(c);
-		center.V.col(6 + c)= back.col(c);
-		center.V.col(12 + c)= right.col(c);
-		center.V.col(18 + c)= left.col(c);
-		center.V.col(24 + c)= up.col(c);
-		center.V.col(30 + c)= down.col(c);
-	}
-
-	for (int c = 0; c < 12; c++) {
-		for (int r = 0; r < 3; r++) {
-			center.F(r, c) = c * 3 + r;
+	mat4 instance_model() {
+		mat4 model = instance_rest_model();
+		for (int i = 0; i < 2; i++) {
+			float d = dot(model[3].xyz, turn_axis[i]);
+			if (d < turn_layer[i].x || d > turn_layer[i].y) continue;
+
+			// Rotation around the axis (Rodrigues), exact at every angle
+			float c = cos(turn_angle[i]);
+			float s = sin(turn_angle[i]);
+			vec3 a = turn_axis[i];
+			mat3 R = mat3(c) + s * mat3(0, a.z, -a.y, -a.z, 0, a.x, a.y, -a.x, 0) + (1 - c) * outerProduct(a, a);
+			return mat4(R) * model;
 		}
-	}	
-
-	/*** Construct all the cubes from the central cube ***/
-	float offset[3] = {-0.30, 0, 0.30};
-	for (int x = 0; x < 3; x++) {
-		for (int y = 0; y < 3; y++) {
-			for (int z = 0; z < 3; z++) {
-				Cube cube;
-				cube.V.resize(3, 36);
-				cube.F.resize(3, 12);
-				cube.F = center.F;
-				for (int p = 0; p < 36; p++) {
-					cube.V.col(p) = center.V.col(p) + Eigen::Vector3f(offset[x], offset[y], offset[z]);
-				}
+		return model;
+	}
+
+	// Vertices of hidden faces all go to this point outside of the view, so
+	// their triangles are empty and never rasterized
+	const vec4 hidden_position = vec4(2.0, 2.0, 2.0, 1.0);
+)";
+
+// Upload the turn being played to a program using instance_model()
+void set_turn_uniforms(const Program &program) {
+	float axis[2][3], layer[2][2], angle[2];
+	for (int i = 0; i < 2; i++) {
+		// Unused turns have an empty layer
+		bool used = player.playing != -1 && i < player.num_turns;
+		for (int k = 0; k < 3; k++) axis[i][k] = used ? player.turns[i].axis(k) : 0;
+		layer[i][0] = used ? player.turns[i].layer_min : 1;
+		layer[i][1] = used ? player.turns[i].layer_max : -1;
+		angle[i] = used ? player.turns[i].angle * player.progress : 0;
+	}
+	glUniform3fv(program.uniform("turn_axis"), 2, &axis[0][0]);
+	glUniform2fv(program.uniform("turn_layer"), 2, &layer[0][0]);
+	glUniform1fv(program.uniform("turn_angle"), 2, angle);
+}
 
-				// Initialize all the cubes to be white
-				cube.C = Eigen::MatrixXf::Constant(3, 36, 0.0f);
-				// Initilize all the texture
-				cube.TX = Eigen::MatrixXf::Constant(2, 36, 0.0f);
+// Point the attributes of a program to the interleaved vertices of the mesh,
+// those it does not use are skipped
+void bind_mesh_attributes(const Program &program) {
+	program.bindVertexAttribArray("position", mesh.VERTICES_vbo, 3, 0);
+	program.bindVertexAttribArray("texCoord", mesh.VERTICES_vbo, 2, 3);
+	program.bindVertexAttribArray("face", mesh.VERTICES_vbo, 1, 5);
+}
 
-				/*** Initialize other parameters ***/
-				cube.vao.init();
-				cube.vao.bind();
+// Build the central cube and upload it to the GPU, along with the instance buffer
+void init_mesh(const Program &program) {
+	// Create the central cube
+	build_cube_mesh(mesh.V, mesh.UV, mesh.FACE, mesh.F);
+	mesh.VERTICES.resize(6, mesh.V.cols());
+	mesh.VERTICES << mesh.V, mesh.UV, mesh.FACE;
+
+	mesh.vao.init();
+	mesh.vao.bind();
+
+	// Initialize and update the VBOs, they never change afterwards
+	mesh.VERTICES_vbo.init(GL_FLOAT, GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+	mesh.F_vbo.init(GL_UNSIGNED_INT, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+	mesh.VERTICES_vbo.update(mesh.VERTICES);
+	mesh.F_vbo.update(mesh.F);
+
+	// The attribute layout and the element buffer are stored in the VAO
+	bind_mesh_attributes(program);
+	mesh.F_vbo.bind();
+
+	// Unbind the VAO
+	mesh.vao.unbind();
+
+	// Instance data is read through a texture buffer (no attribute divisors in GL 3.2)
+	instance_vbo.init(GL_FLOAT, GL_TEXTURE_BUFFER);
+	// A buffer only exists once bound, glTexBuffer() refuses a bare name
+	instance_vbo.bind();
+	instance_vbo.unbind();
+	glGenTextures(1, &instance_texture);
+	glBindTexture(GL_TEXTURE_BUFFER, instance_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instance_vbo.id);
+
+	// The cubes of every face, through a second texture buffer
+	face_cubes_vbo.init(GL_INT, GL_TEXTURE_BUFFER);
+	face_cubes_vbo.bind();
+	face_cubes_vbo.unbind();
+	glGenTextures(1, &face_cubes_texture);
+	glBindTexture(GL_TEXTURE_BUFFER, face_cubes_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, face_cubes_vbo.id);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	check_gl_error();
+}
 
-				// Initialize the VBOs
-				cube.V_vbo.init(GL_FLOAT, GL_ARRAY_BUFFER);
-				cube.C_vbo.init(GL_FLOAT, GL_ARRAY_BUFFER);
-				cube.T_vbo.init(GL_FLOAT, GL_ARRAY_BUFFER);
-				cube.F_vbo.init(GL_UNSIGNED_INT, GL_ELEMENT_ARRAY_BUFFER);
+// Upload the model matrix and stickers of every cube to the instance buffer
+void update_instances() {
+	instances.resize(4, 6 * cubes.size());
+	for (int c = 0; c < (int) cubes.size(); c++) {
+		Eigen::Matrix4f model = cubes[c].T * Eigen::Affine3f(Eigen::Translation3f(cubes[c].home.cast<float>())).matrix();
+		instances.block<4, 4>(0, 6 * c) = model;
+		instances.col(6 * c + 4) << cubes[c].stickers[0], cubes[c].stickers[1], cubes[c].stickers[2], cubes[c].stickers[3];
+		instances.col(6 * c + 5) << cubes[c].stickers[4], cubes[c].stickers[5], 0, 0;
+	}
+	instance_vbo.update(instances);
+}
 
-				// Update the VBOs
-				cube.V_vbo.update(cube.V);
-				cube.C_vbo.update(cube.C);
-				cube.T_vbo.update(cube.TX);
-				cube.F_vbo.update(cube.F);
+// Group the cubes by the faces they show and upload them, once per puzzle:
+// the faces a cube shows follow it through the moves
+void update_face_cubes() {
+	face_cubes.resize(6 * cubes.size());
+	int count = 0;
+	for (int f = 0; f < 6; f++) {
+		face_offsets[f] = count;
+		for (int c = 0; c < (int) cubes.size(); c++) {
+			if (cubes[c].exposed & (1 << f)) face_cubes(count++) = c;
+		}
+	}
+	face_offsets[6] = count;
+	face_cubes.conservativeResize(count);
+	face_cubes_vbo.update(face_cubes);
+}
 
-				// Bind the element buffer, this information will be stored in the current VAO
-				cube.F_vbo.bind();
+// Draw the mesh with a program using instance_model(), one face at a time
+void draw_cube_faces(const Program &program) {
+	for (int f = 0; f < 6; f++) {
+		int count = face_offsets[f + 1] - face_offsets[f];
+		if (count == 0) continue;
+		glUniform1i(program.uniform("face_offset"), face_offsets[f]);
+		glDrawElementsInstanced(GL_TRIANGLES, 6, mesh.F_vbo.scalar_type, (void *) (6 * f * sizeof(GLuint)), count);
+	}
+}
 
-				// Unbind the VAO
-				cube.vao.unbind();
+////////////////////////////////////////////////////////////////////////////////
 
-				// Trandforming matrix
-				cube.T = Eigen::Matrix4f::Identity();
+// A function to play the animation up to a time point: the wall clock in the
+// window, the time of the next frame when exporting. Only the progress of the
+// turn changes from frame to frame, the cubes are turned by the vertex shader.
+void play(std::chrono::high_resolution_clock::time_point t_now) {
+	if (player.play(t_now, cubes, puzzle_size, cube_state)) {
+		std::cout << player.moves.size() << " steps left" << std::endl;
+		update_instances();
+		redraw = true;
+	}
+}
 
-				// Add the cube to the array
-				cubes.push_back(cube);
-			}
-		}
-	} 
-
-	int f[9] = {2, 5, 8, 11, 14, 17, 20, 23, 26};
-	int b[9] = {0, 3, 6, 9, 12, 15, 18, 21, 24};
-	int r[9] = {18, 19, 20, 21, 22, 23, 24, 25, 26};
-	int l[9] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
-	int u[9] = {6, 7, 8, 15, 16, 17, 24, 25, 26};
-	int d[9] = {0, 1, 2, 9, 10, 11, 18, 19, 20};
-	for (int i = 0; i < 9; i++) {
-		front_faces.insert(f[i]);
-		back_faces.insert(b[i]);
-		right_faces.insert(r[i]);
-		left_faces.insert(l[i]);
-		up_faces.insert(u[i]);
-		down_faces.insert(d[i]);
-	}
-	
-	/*** Initialize colors for all the cube ***/
-	// Front faces
-	for (const auto &face : front_faces) {
-		// 6 vertices on a face of a cube
-		for (int v = 0; v < 6; v++) {
-			cubes[face].C.col(FR*6+v) << 243/255.0, 243/255.0, 243/255.0; 
-		}
-		cubes[face].TX.col(FR*6+0) << 1.0/6, 1.0;
-		cubes[face].TX.col(FR*6+1) << 1.0/6, 0.5;
-		cubes[face].TX.col(FR*6+2) << 0.0, 0.5;
-		cubes[face].TX.col(FR*6+3) << 1.0/6, 1.0;
-		cubes[face].TX.col(FR*6+4) << 0.0, 1.0;
-		cubes[face].TX.col(FR*6+5) << 0.0, 0.5;
-	}
-
-	// Back faces
-	for (const auto &face : back_faces) {
-		// 6 vertices on a face of a cube
-		for (int v = 0; v < 6; v++) {
-			cubes[face].C.col(BA*6+v) << 240/255.0, 179/255.0, 42/255.0; 
-		}
-		cubes[face].TX.col(BA*6+0) << 2.0/6, 1.0;
-		cubes[face].TX.col(BA*6+1) << 2.0/6, 0.5;
-		cubes[face].TX.col(BA*6+2) << 1.0/6, 0.5;
-		cubes[face].TX.col(BA*6+3) << 2.0/6, 1.0;
-		cubes[face].TX.col(BA*6+4) << 1.0/6, 1.0;
-		cubes[face].TX.col(BA*6+5) << 1.0/6, 0.5;
-	}
-
-	// Right faces
-	for (const auto &face : right_faces) {
-		// 6 vertices on a face of a cube
-		for (int v = 0; v < 6; v++) {
-			cubes[face].C.col(RI*6+v) << 88/255.0, 128/255.0, 243/255.0; 
-		}
-		cubes[face].TX.col(RI*6+0) << 3.0/6, 1.0;
-		cubes[face].TX.col(RI*6+1) << 3.0/6, 0.5;
-		cubes[face].TX.col(RI*6+2) << 2.0/6, 0.5;
-		cubes[face].TX.col(RI*6+3) << 3.0/6, 1.0;
-		cubes[face].TX.col(RI*6+4) << 2.0/6, 1.0;
-		cubes[face].TX.col(RI*6+5) << 2.0/6, 0.5;
-	}
-	
-	// Left faces
-	for (const auto &face : left_faces) {
-		// 6 vertices on a face of a cube
-		for (int v = 0; v < 6; v++) {
-			cubes[face].C.col(LE*6+v) << 50/255.0, 156/255.0, 88/255.0; 
-		}
-		cubes[face].TX.col(LE*6+0) << 4.0/6, 1.0;
-		cubes[face].TX.col(LE*6+1) << 4.0/6, 0.5;
-		cubes[face].TX.col(LE*6+2) << 3.0/6, 0.5;
-		cubes[face].TX.col(LE*6+3) << 4.0/6, 1.0;
-		cubes[face].TX.col(LE*6+4) << 3.0/6, 1.0;
-		cubes[face].TX.col(LE*6+5) << 3.0/6, 0.5;
-	}
-
-	// Up faces
-	for (const auto &face : up_faces) {
-		// 6 vertices on a face of a cube
-		for (int v = 0; v < 6; v++) {
-			cubes[face].C.col(UP*6+v) << 226/255.0, 112/255.0, 30/255.0; 
-		}
-		cubes[face].TX.col(UP*6+0) << 5.0/6, 1.0;
-		cubes[face].TX.col(UP*6+1) << 5.0/6, 0.5;
-		cubes[face].TX.col(UP*6+2) << 4.0/6, 0.5;
-		cubes[face].TX.col(UP*6+3) << 5.0/6, 1.0;
-		cubes[face].TX.col(UP*6+4) << 4.0/6, 1.0;
-		cubes[face].TX.col(UP*6+5) << 4.0/6, 0.5;
-	}
-
-	// Down faces
-	for (const auto &face : down_faces) {
-		// 6 vertices on a face of a cube
-		for (int v = 0; v < 6; v++) {
-			cubes[face].C.col(DO*6+v) << 221/255.0, 68/255.0, 51/255.0; 
-		}
-		cubes[face].TX.col(DO*6+0) << 1.0, 1.0;
-		cubes[face].TX.col(DO*6+1) << 1.0, 0.5;
-		cubes[face].TX.col(DO*6+2) << 5.0/6, 0.5;
-		cubes[face].TX.col(DO*6+3) << 1.0, 1.0;
-		cubes[face].TX.col(DO*6+4) << 5.0/6, 1.0;
-		cubes[face].TX.col(DO*6+5) << 5.0/6, 0.5;
-	}
-
-	for (int c = 0; c < 27; c++) {
-		cubes[c].C_vbo.update(cubes[c].C);
-		cubes[c].T_vbo.update(cubes[c].TX);
-	}
-
-	cubes[14].TX.col(FR*6+0) << 1.0/6, 0.5;
-	cubes[14].TX.col(FR*6+1) << 1.0/6, 0.0;
-	cubes[14].TX.col(FR*6+2) << 0.0, 0.0;
-	cubes[14].TX.col(FR*6+3) << 1.0/6, 0.5;
-	cubes[14].TX.col(FR*6+4) << 0.0, 0.5;
-	cubes[14].TX.col(FR*6+5) << 0.0, 0.0;
-	cubes[14].T_vbo.update(cubes[14].TX);
+// Whether a turn is playing or waiting in the queue
+bool animating() {
+	return player.animating();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// A function to play the animation
-void play() {
-	if (rotation_option == -1 && rotation_options.size() > 0) {
-		rotation_option = rotation_options.front();
-		frame_cnt = 0;
-	}
-	if (frame_cnt != -1 && frame_cnt < FRAME_NUM - 1)  {
-		float time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - t_start).count();
-		time *= 24.0; // speed up the animation
-		if (time > 1) {
-			// If it is the last frame, finish the rotation by setting the model matrix
-			// And update the 6 unordered sets
-			if (frame_cnt == FRAME_NUM - 2) {
-				if (rotation_option == 0) {
-					int count = 0;
-					for (const auto &face : front_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							up_faces.insert(face);
-						}
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							left_faces.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							down_faces.insert(face);
-						}
-						for (const auto &t : temp) right_faces.insert(t);
-					}
-				}
-				if (rotation_option == 1) {
-					int count = 0;
-					for (const auto &face : back_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							up_faces.insert(face);
-						}
-						
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							right_faces.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							down_faces.insert(face);
-						}
-						for (const auto &t : temp) left_faces.insert(t);
-					}
-				}
-				if (rotation_option == 2) {
-					int count = 0;
-					for (const auto &face : right_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							up_faces.insert(face);
-						}
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							front_faces.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							down_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) back_faces.insert(t);
-					}
-				}
-				if (rotation_option == 3) {
-					int count = 0;
-					for (const auto &face : left_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							up_faces.insert(face);
-						}
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							back_faces.insert(face);
-						}
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							down_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) front_faces.insert(t);
-					}
-				}
-				if (rotation_option == 4) {
-					int count = 0;
-					for (const auto &face : up_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							temp.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							front_faces.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							right_faces.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							back_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) left_faces.insert(t);
-					}
-				}
-				if (rotation_option == 5) {
-					int count = 0;
-					for (const auto &face : down_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							temp.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							front_faces.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							left_faces.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							back_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) right_faces.insert(t);
-					}
-				}
-				if (rotation_option == 6) {
-					int count = 0;
-					for (const auto &face : front_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							up_faces.insert(face);
-						}
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							right_faces.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							down_faces.insert(face);
-						}
-						for (const auto &t : temp) left_faces.insert(t);
-					}
-				}
-				if (rotation_option == 7) {
-					int count = 0;
-					for (const auto &face : back_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							up_faces.insert(face);
-						}
-						
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							left_faces.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							down_faces.insert(face);
-						}
-						for (const auto &t : temp) right_faces.insert(t);
-					}
-				}
-				if (rotation_option == 8) {
-					int count = 0;
-					for (const auto &face : right_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							up_faces.insert(face);
-						}
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							back_faces.insert(face);
-						}
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							down_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) front_faces.insert(t);
-					}
-				}
-				if (rotation_option == 9) {
-					int count = 0;
-					for (const auto &face : left_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (up_faces.find(face) != up_faces.end()) {
-							up_faces.erase(face);
-							temp.insert(face);
-						}
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							up_faces.insert(face);
-						}
-						if (down_faces.find(face) != down_faces.end()) {
-							down_faces.erase(face);
-							front_faces.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							down_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) back_faces.insert(t);
-					}
-				}
-				if (rotation_option == 10) {
-					int count = 0;
-					for (const auto &face : up_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							temp.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							front_faces.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							left_faces.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							back_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) right_faces.insert(t);
-					}
-				}
-				if (rotation_option == 11) {
-					int count = 0;
-					for (const auto &face : down_faces) {
-						cubes[face].T = frames[count*FRAME_NUM+FRAME_NUM-1];
-						count++;
-
-						std::unordered_set<int> temp;
-						if (front_faces.find(face) != front_faces.end()) {
-							front_faces.erase(face);
-							temp.insert(face);
-						}
-						if (right_faces.find(face) != right_faces.end()) {
-							right_faces.erase(face);
-							front_faces.insert(face);
-						}
-						if (back_faces.find(face) != back_faces.end()) {
-							back_faces.erase(face);
-							right_faces.insert(face);
-						}
-						if (left_faces.find(face) != left_faces.end()) {
-							left_faces.erase(face);
-							back_faces.insert(face);
-						}
-						
-						for (const auto &t : temp) left_faces.insert(t);
-					}
-				}
+// Move of a rotation option (0-5 clockwise, 6-11 counter clockwise)
+int option_move(int option) {
+	return option % 6 * 3 + (option < 6 ? 0 : 2);
+}
 
-				if (!rotation_reversed.empty() && (rotation_reversed.top()+6)%12 == rotation_options.front()) 
-					rotation_reversed.pop();
-				else 
-					rotation_reversed.push(rotation_options.front());
-				rotation_options.pop();
-				rotation_started.pop();
+// Append moves (see move_axis) to the queue. Every move source goes through
+// here: the moves are simplified along with the queued moves that have not
+// started yet.
+void queue_moves(const std::vector<int> &moves) {
+	int started = player.playing == -1 ? 0 : player.num_turns;
+	std::vector<int> pending(player.moves.begin() + started, player.moves.end());
+	pending.insert(pending.end(), moves.begin(), moves.end());
+	simplify_moves(pending);
+
+	player.moves.resize(started);
+	player.moves.insert(player.moves.end(), pending.begin(), pending.end());
+}
 
-				std::cout << rotation_options.size() << " steps left" << std::endl;
-				if (rotation_options.size() > 0) {
-					rotation_option = rotation_options.front();
+// Append a single rotation option to the queue
+void queue_move(int option) {
+	queue_moves(std::vector<int>(1, option_move(option)));
+}
 
-					frame_cnt = 0;
-				}
-				else {
-					rotation_option = -1;
-					frame_cnt = -1;
-				}
-			}
+// Keys of the slice moves and cube rotations, in the order of their axes
+const int axis_keys[6] = {GLFW_KEY_M, GLFW_KEY_E, GLFW_KEY_S, GLFW_KEY_X, GLFW_KEY_Y, GLFW_KEY_Z};
 
-			t_start = std::chrono::high_resolution_clock::now();
-			if (frame_cnt != -1) frame_cnt++;
-		}
-		else {	
-			// Linear interpolate model matrix
-			if (rotation_option == 0 || rotation_option == 6) {
-				if (rotation_option == 0) rotate_front();
-				else rotate_front_ccw();
-				int count = 0;
-				for (const auto &face : front_faces) {
-					cubes[face].T = (1-time) * frames[FRAME_NUM * count + frame_cnt] + time * frames[FRAME_NUM * count + frame_cnt + 1];
-					count++;
-				}
-			}
-			if (rotation_option == 1 || rotation_option == 7) {
-				if (rotation_option == 1) rotate_back();
-				else rotate_back_ccw();
-				int count = 0;
-				for (const auto &face : back_faces) {
-					cubes[face].T = (1-time) * frames[FRAME_NUM * count + frame_cnt] + time * frames[FRAME_NUM * count + frame_cnt + 1];
-					count++;
-				}
-			}
-			if (rotation_option == 2 || rotation_option == 8) {
-				if (rotation_option == 2) rotate_right();
-				else rotate_right_ccw();
-				int count = 0;
-				for (const auto &face : right_faces) {
-					cubes[face].T = (1-time) * frames[FRAME_NUM * count + frame_cnt] + time * frames[FRAME_NUM * count + frame_cnt + 1];
-					count++;
-				}
-			}
-			if (rotation_option == 3 || rotation_option == 9) {
-				if (rotation_option == 3) rotate_left();
-				else rotate_left_ccw();
-				int count = 0;
-				for (const auto &face : left_faces) {
-					cubes[face].T = (1-time) * frames[FRAME_NUM * count + frame_cnt] + time * frames[FRAME_NUM * count + frame_cnt + 1];
-					count++;
-				}
-			}
-			if (rotation_option == 4 || rotation_option == 10) {
-				if (rotation_option == 4) rotate_up();
-				else rotate_up_ccw();
-				int count = 0;
-				for (const auto &face : up_faces) {
-					cubes[face].T = (1-time) * frames[FRAME_NUM * count + frame_cnt] + time * frames[FRAME_NUM * count + frame_cnt + 1];
-					count++;
-				}
-			}
-			if (rotation_option == 5 || rotation_option == 11) {
-				if (rotation_option == 5) rotate_down();
-				else rotate_down_ccw();
-				int count = 0;
-				for (const auto &face : down_faces) {
-					cubes[face].T = (1-time) * frames[FRAME_NUM * count + frame_cnt] + time * frames[FRAME_NUM * count + frame_cnt + 1];
-					count++;
-				}
-			}
+// Queue the slice move or rotation of a key, counter clockwise with shift
+void key_callback_axis(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action != GLFW_RELEASE) return;
+	for (int a = 0; a < 6; a++) {
+		// Slice moves of a 2x2x2 turn no layer
+		if (axis_keys[a] == key && puzzle_move_axis((6 + a) * 3, puzzle_size).layers != 0) {
+			queue_moves(std::vector<int>(1, (6 + a) * 3 + (mods & GLFW_MOD_SHIFT ? 2 : 0)));
 		}
 	}
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
 
 // Add a rubik's cube to the scene
@@ -800,313 +429,61 @@ void key_callback_1(GLFWwindow* window, int key, int scancode, int action, int m
 void key_callback_C(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	view = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/4.0, Eigen::Vector3f::UnitX())).matrix() * 
 		Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/4.0, Eigen::Vector3f::UnitY())).matrix();
+	redraw = true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void rotate_front() {
-	if (rotation_started.front()) return; 
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : front_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitZ())).matrix() * cubes[face].T);
-		}
-	}
-
-	t_start = std::chrono::high_resolution_clock::now();
-
-	frame_cnt = 0;
-	rotation_started.front() = true;
-}
-
-
 // Rotate the front face clock wise
 void key_callback_F(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action == GLFW_RELEASE) {
-		rotation_options.push(0);
-		rotation_started.push(false);
+		queue_move(0);
 	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void rotate_back() {
-	if (rotation_started.front()) return; 
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : back_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitZ())).matrix() * cubes[face].T);
-		}
-	}
-
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
-
 // Rotate the back face clock wise
 void key_callback_B(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action == GLFW_RELEASE) {
-		rotation_options.push(1);
-		rotation_started.push(false);
+		queue_move(1);
 	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void rotate_right() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : right_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitX())).matrix() * cubes[face].T);
-		}
-	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
 // Rotate the right face clock wise
 void key_callback_R(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action == GLFW_RELEASE) {
-		rotation_options.push(2);
-		rotation_started.push(false);
+		queue_move(2);
 	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void rotate_left() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : left_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitX())).matrix() * cubes[face].T);
-		}
-	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
 // Rotate the left face clock wise
 void key_callback_L(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action == GLFW_RELEASE) {
-		rotation_options.push(3);
-		rotation_started.push(false);
+		queue_move(3);
 	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void rotate_up() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : up_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitY())).matrix() * cubes[face].T);
-		}
-	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
-
 // Rotate the up face clock wise
 void key_callback_U(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action == GLFW_RELEASE) {
-		rotation_options.push(4);
-		rotation_started.push(false);
+		queue_move(4);
 	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void rotate_down() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : down_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitY())).matrix() * cubes[face].T);
-		}
-	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
 // Rotate the down face clock wise
 void key_callback_D(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action == GLFW_RELEASE) {
-		rotation_options.push(5);
-		rotation_started.push(false);
-	}
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void rotate_front_ccw() {
-	if (rotation_started.front()) return; 
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : front_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitZ())).matrix() * cubes[face].T);
-		}
-	}
-
-	t_start = std::chrono::high_resolution_clock::now();
-
-	frame_cnt = 0;
-	rotation_started.front() = true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void rotate_back_ccw() {
-	if (rotation_started.front()) return; 
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : back_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitZ())).matrix() * cubes[face].T);
-		}
-	}
-
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void rotate_right_ccw() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : right_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitX())).matrix() * cubes[face].T);
-		}
-	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void rotate_left_ccw() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : left_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitX())).matrix() * cubes[face].T);
-		}
-	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void rotate_up_ccw() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : up_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitY())).matrix() * cubes[face].T);
-		}
-	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void rotate_down_ccw() {
-	if (rotation_started.front()) return;
-
-	// Reset the frame buffer
-	frames.clear();
-
-	for (const auto &face : down_faces) {
-		Eigen::MatrixXf frame = cubes[face].T;
-		// 60 frames per rotation
-		for (int f = 0; f < FRAME_NUM; f++) {
-			frames.push_back(Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2*f/(FRAME_NUM-1), Eigen::Vector3f::UnitY())).matrix() * cubes[face].T);
-		}
+		queue_move(5);
 	}
-	t_start = std::chrono::high_resolution_clock::now();
-	frame_cnt = 0;
-
-	rotation_started.front() = true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1115,43 +492,45 @@ void key_callback_ccw(GLFWwindow* window, int key, int scancode, int action, int
 	switch (key) {
 		case GLFW_KEY_F:
 			if (action == GLFW_RELEASE) {
-				rotation_options.push(6);
-				rotation_started.push(false);
+				queue_move(6);
 			}
 			break;
 		case GLFW_KEY_B:
 			if (action == GLFW_RELEASE) {
-				rotation_options.push(7);
-				rotation_started.push(false);
+				queue_move(7);
 			}
 			break;
 		case GLFW_KEY_R:
 			if (action == GLFW_RELEASE) {
-				rotation_options.push(8);
-				rotation_started.push(false);
+				queue_move(8);
 			}
 			break;
 		case GLFW_KEY_L:
 			if (action == GLFW_RELEASE) {
-				rotation_options.push(9);
-				rotation_started.push(false);
+				queue_move(9);
 			}
 			break;
 		case GLFW_KEY_U:
 			if (action == GLFW_RELEASE) {
-				rotation_options.push(10);
-				rotation_started.push(false);
+				queue_move(10);
 			}
 			break;
 		case GLFW_KEY_D:
 			if (action == GLFW_RELEASE) {
-				rotation_options.push(11);
-				rotation_started.push(false);
+				queue_move(11);
 			}
 			break;
 		case GLFW_KEY_LEFT_SHIFT:
 			key_callback_LEFT_SHIFT(window, key, scancode, action, mods);
 			break;
+		case GLFW_KEY_M:
+		case GLFW_KEY_E:
+		case GLFW_KEY_S:
+		case GLFW_KEY_X:
+		case GLFW_KEY_Y:
+		case GLFW_KEY_Z:
+			key_callback_axis(window, key, scancode, action, mods);
+			break;
 		default:
 			break;
 	}
@@ -1176,21 +555,282 @@ void key_callback_LEFT_SHIFT(GLFWwindow* window, int key, int scancode, int acti
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// Solve the cube
-void key_callback_SPACE(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	if (action == GLFW_RELEASE) {
-		while (!rotation_reversed.empty()) {
-			rotation_options.push((rotation_reversed.top()+6)%12);
-			rotation_started.push(false);
-			rotation_reversed.pop();
-		}
+// The state reached once all the queued rotations are played
+OrientedState queued_state() {
+	OrientedState target = cube_state;
+	for (int m : player.moves) {
+		target.move(m);
 	}
+	return target;
 }
 
-//////////////////////////////////////////////////////////////////////////////////
+// Queue the moves of a solution. The solver names the faces of the cube
+// state, they are turned into the faces of the world.
+void queue_solution(const std::vector<int> &solution) {
+	OrientedState target = queued_state();
+	std::vector<int> moves(solution);
+	for (int &m : moves) {
+		m = target.world_face(m / 3) * 3 + m % 3;
+	}
+	queue_moves(moves);
+	std::cout << "Solution found: " << solution.size() << " moves" << std::endl;
+}
 
-double original_xcanonical;
-double original_ycanonical;
+// Start solving the state reached after the queued rotations in the background
+void start_solve(const SolveJob::Solve &solve) {
+	if (solve_job.active()) {
+		std::cout << "A solve is already running, press ESC to cancel it" << std::endl;
+		return;
+	}
+	if (puzzle_size != 3) {
+		std::cout << "The solvers only handle the 3x3x3" << std::endl;
+		return;
+	}
+	shown_depth = -1;
+	solve_job.start(queued_state().state, solve);
+}
+
+// Called every frame: show the progress of the background solve and queue its
+// moves once it is done. Only reads atomics, so it never blocks the frame.
+void poll_solve_job(GLFWwindow* window) {
+	if (!solve_job.active()) return;
+	if (!solve_job.finished()) {
+		int depth = solve_job.control.depth;
+		if (depth != shown_depth) {
+			shown_depth = depth;
+			char title[64];
+			snprintf(title, sizeof(title), "Interactive Rubik's Cube - solving, depth %d", depth);
+			glfwSetWindowTitle(window, title);
+		}
+		return;
+	}
+	solve_job.join();
+	glfwSetWindowTitle(window, "Interactive Rubik's Cube");
+	if (solve_job.control.cancelled()) {
+		std::cout << "Solve cancelled" << std::endl;
+	}
+	else if (!solve_job.solved) {
+		std::cout << "No solution found" << std::endl;
+	}
+	else if (!solve_job.state.same_cubies(queued_state().state)) {
+		// The cube was turned or reset while solving
+		std::cout << "The cube changed during the solve, solution dropped" << std::endl;
+	}
+	else {
+		queue_solution(solve_job.solution);
+	}
+}
+
+// Solve the cube
+void key_callback_SPACE(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action == GLFW_RELEASE) {
+		start_solve([](const CubeState &state, std::vector<int> &solution, SolveControl &control) {
+			if (!solver.ready && !solver.init(DATA_DIR "tables")) {
+				std::cerr << "Could not load the pruning tables" << std::endl;
+				return false;
+			}
+			return solver.solve(state, solution, 22, &control);
+		});
+	}
+}
+
+// Solve the cube with the fewest possible moves
+void key_callback_O(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action == GLFW_RELEASE) {
+		start_solve([](const CubeState &state, std::vector<int> &solution, SolveControl &control) {
+			if (!optimal_solver.ready && !optimal_solver.init(DATA_DIR "tables")) {
+				std::cerr << "Could not load the pattern databases" << std::endl;
+				return false;
+			}
+			return optimal_solver.solve(state, solution, 20, &control);
+		});
+	}
+}
+
+// Cancel the running solve
+void key_callback_ESCAPE(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action == GLFW_RELEASE && solve_job.active()) {
+		solve_job.cancel();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Offscreen framebuffer holding the cube and face id of every pixel. Only the
+// pixel under the cursor is drawn and read back, through a pixel buffer object
+// so the CPU never waits on the GPU.
+struct PickBuffer {
+	Program program;
+	VertexArrayObject vao; // position and face of the shared mesh
+
+	GLuint fbo = 0;
+	GLuint ids = 0;   // GL_RG32I: cube, face of the central cube (-1 for background)
+	GLuint depth = 0;
+	int width = 0;
+	int height = 0;
+
+	GLuint pbo = 0;       // receives the 2 ints of the pixel
+	GLsync fence = 0;     // signaled once the pixel reached the PBO
+
+	bool supported = false; // the driver renders to integer buffers
+};
+
+PickBuffer pick_buffer;
+
+// Pick on the GPU instead of casting a ray, toggled with P
+bool gpu_picking = true;
+
+// A click waiting for its pick: pixel, and whether it is drawn already
+bool pick_pending = false;
+bool pick_drawn = false;
+int pick_x, pick_y;
+
+// The button was released before the pick arrived
+bool release_pending = false;
+double release_xcanonical, release_ycanonical;
+
+// Build the id shaders and the offscreen framebuffer, GPU picking is turned
+// off if the driver cannot render to integer buffers
+void init_pick_buffer() {
+	std::string vertex_shader = std::string("#version 150 core\n") + instance_model_shader + R"(
+		uniform mat4 view;
+		uniform mat4 proj;
+
+		in vec3 position;
+		in float face;
+
+		flat out ivec2 f_id;
+
+		void main() {
+			gl_Position = proj * view * instance_model() * vec4(position, 1.0);
+			if (!face_visible(int(face))) gl_Position = hidden_position;
+			f_id = ivec2(instance_cube(), int(face));
+		}
+	)";
+
+	const GLchar* fragment_shader = R"(
+		#version 150 core
+
+		flat in ivec2 f_id;
+
+		out ivec2 outId;
+
+		void main() {
+			outId = f_id;
+		}
+	)";
+
+	PickBuffer &pb = pick_buffer;
+	if (!pb.program.init(vertex_shader, fragment_shader, "outId")) {
+		gpu_picking = false;
+		return;
+	}
+	pb.program.bind();
+	glUniform1i(pb.program.uniform("instances"), 1);
+	glUniform1i(pb.program.uniform("face_cubes"), 2);
+
+	pb.vao.init();
+	pb.vao.bind();
+	bind_mesh_attributes(pb.program);
+	mesh.F_vbo.bind();
+	pb.vao.unbind();
+
+	glGenFramebuffers(1, &pb.fbo);
+	glGenRenderbuffers(1, &pb.ids);
+	glGenRenderbuffers(1, &pb.depth);
+	glBindFramebuffer(GL_FRAMEBUFFER, pb.fbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, pb.ids);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RG32I, 1, 1);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, pb.ids);
+	glBindRenderbuffer(GL_RENDERBUFFER, pb.depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1, 1);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, pb.depth);
+	pb.supported = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!pb.supported) {
+		std::cerr << "Integer framebuffers are not supported, picking with rays" << std::endl;
+		gpu_picking = false;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	pb.width = pb.height = 1;
+
+	glGenBuffers(1, &pb.pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(GLint), NULL, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	check_gl_error();
+}
+
+void free_pick_buffer() {
+	PickBuffer &pb = pick_buffer;
+	if (pb.fence) glDeleteSync(pb.fence);
+	glDeleteBuffers(1, &pb.pbo);
+	glDeleteRenderbuffers(1, &pb.ids);
+	glDeleteRenderbuffers(1, &pb.depth);
+	glDeleteFramebuffers(1, &pb.fbo);
+	pb.vao.free();
+	pb.program.free();
+}
+
+// Ask for the ids under a pixel of the framebuffer (origin at the bottom left)
+void request_pick(int x, int y) {
+	pick_pending = true;
+	pick_drawn = false;
+	release_pending = false;
+	pick_x = x;
+	pick_y = y;
+	redraw = true;
+}
+
+// Draw the requested pixel into the id buffer and start copying it to the
+// PBO. Called right after the frame is drawn, with the same instance data.
+void render_pick(Program &program, int width, int height) {
+	PickBuffer &pb = pick_buffer;
+	if (!pick_pending || pick_drawn) return;
+	pick_drawn = true;
+
+	// Follow the size of the window so ids line up with the pixels on screen
+	if (pb.width != width || pb.height != height) {
+		pb.width = width;
+		pb.height = height;
+		glBindRenderbuffer(GL_RENDERBUFFER, pb.ids);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RG32I, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, pb.depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, pb.fbo);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(pick_x, pick_y, 1, 1);
+	const GLint background[4] = {-1, -1, 0, 0};
+	glClearBufferiv(GL_COLOR, 0, background);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	pb.program.bind();
+	glUniformMatrix4fv(pb.program.uniform("proj"), 1, GL_FALSE, proj.data());
+	glUniformMatrix4fv(pb.program.uniform("view"), 1, GL_FALSE, view.data());
+	set_turn_uniforms(pb.program);
+	pb.vao.bind();
+	draw_cube_faces(pb.program);
+	pb.vao.unbind();
+
+	// Asynchronous read: glReadPixels returns at once when packing into a PBO
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.pbo);
+	glReadPixels(pick_x, pick_y, 1, 1, GL_RG_INTEGER, GL_INT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	pb.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	program.bind();
+	check_gl_error();
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+
+double original_xcanonical;
+double original_ycanonical;
 bool pressed = false;
 
 void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -1220,10 +860,120 @@ void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos) {
 
 	original_xcanonical = xcanonical;
 	original_ycanonical = ycanonical;
+	redraw = true;
+}
+
+// The window was resized or its contents were damaged
+void window_refresh_callback(GLFWwindow* window) {
+	redraw = true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// A click landed on a cube, or on the background (pick.cube == -1) which
+// starts the trackball
+void begin_drag(const Pick &pick) {
+	selected_obj = pick.cube;
+	if (selected_obj == -1) {
+		pressed = true;
+	}
+}
+
+// The button was released at (xcanonical, ycanonical): a drag across a cube
+// turns one of its layers
+void end_drag(double xcanonical, double ycanonical) {
+	// If no object is selected, stop the track ball
+	if (selected_obj == -1) {
+		pressed = false;
+		return;
+	}
+	double x = xcanonical - original_xcanonical;
+	double y = ycanonical - original_ycanonical;
+
+	Eigen::Matrix4f view_original = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/4.0, Eigen::Vector3f::UnitX())).matrix() * 
+		Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/4.0, Eigen::Vector3f::UnitY())).matrix();
+	Eigen::Matrix4f view_transform = view * view_original.inverse();
+
+	Eigen::Vector4f xy;
+	xy << x, y, 0, 1;
+
+	Eigen::Vector4f xy_temp = view_transform * xy;
+
+	x = xy_temp(0);
+	y = xy_temp(1);
+	// std::cout << "(" << x << ", " << y << ")" << std::endl;
+
+	if (on_face(selected_obj, FR)) {
+		if (x * y <= 0 && abs(x) < abs(y)) {
+			queue_move(x > 0 ? 0 : 6);
+				return;
+		}
+	}
+	if (on_face(selected_obj, BA)) {
+		if (x * y <= 0 && abs(x) < abs(y)) {
+			queue_move(x > 0 ? 7 : 1);
+				return;
+		}
+	}
+	if (on_face(selected_obj, RI)) {
+		if (x * y > 0 && abs(x) < abs(y)) {
+			queue_move(x > 0 ? 2 : 8);
+				return;
+		}
+	}
+	if (on_face(selected_obj, LE)) {
+		if (x * y > 0 && abs(x) < abs(y)) {
+			queue_move(x > 0 ? 9 : 3);
+				return;
+		}
+	}
+	if (on_face(selected_obj, UP)) {
+		if (abs(x) > abs(y)) {
+			queue_move(x > 0 ? 10 : 4);
+				return;
+		}
+	}
+	if (on_face(selected_obj, DO)) {
+		if (abs(x) > abs(y)) {
+			queue_move(x > 0 ? 5 : 11);
+				return;
+		}
+	}
+}
+
+// Called every frame: once the id of the clicked pixel reached the PBO, start
+// the drag, and finish it if the button was released meanwhile. Never waits.
+void poll_pick() {
+	PickBuffer &pb = pick_buffer;
+	if (!pb.fence) return;
+	GLenum status = glClientWaitSync(pb.fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) return;
+	TRACE_SCOPE("pick_readback");
+	glDeleteSync(pb.fence);
+	pb.fence = 0;
+
+	GLint id[2] = {-1, -1};
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.pbo);
+	const GLint *mapped = (const GLint *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(id), GL_MAP_READ_BIT);
+	if (mapped) {
+		id[0] = mapped[0];
+		id[1] = mapped[1];
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	Pick pick;
+	pick.cube = id[0] >= 0 && id[0] < (int) cubes.size() ? id[0] : -1;
+	pick.face = pick.cube >= 0 ? puzzle_face(cubes[pick.cube], id[1]) : -1;
+	pick.t = 0; // not known from the id buffer
+	pick_pending = false;
+	begin_drag(pick);
+	if (release_pending) {
+		release_pending = false;
+		end_drag(release_xcanonical, release_ycanonical);
+	}
+}
+
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
 	// Get viewport size (canvas in number of pixels)
 	int width, height;
@@ -1247,133 +997,72 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 	double ycanonical = (((height-1-ypos)/double(height))*2)-1; // NOTE: y axis is flipped in glfw
 
 	if (action == GLFW_PRESS) {
-		Eigen::Vector4f ray_canonical;
-		ray_canonical << xcanonical, ycanonical, 1.0, 1.0;
+		TRACE_SCOPE("pick");
+		original_xcanonical = xcanonical;
+		original_ycanonical = ycanonical;
+		if (pick_pending) return;
+		if (gpu_picking) {
+			// The drag starts once the id under the cursor is read back
+			request_pick(int(xpos), int(height-1-ypos));
+			return;
+		}
 
 		Eigen::Vector3f ray_origin;
 		ray_origin << xcanonical, ycanonical, 1.0;
 		Eigen::Vector3f ray_direction(0, 0, -1);
-
-		bool intersection_found = false;
-		double min_param = INT_MAX;
-		for (int m = 0; m < cubes.size(); m++) {
-			for (int i = 0; i < cubes[m].F.cols(); i++) {
-				Eigen::Vector4f a_temp;
-				Eigen::Vector4f b_temp;
-				Eigen::Vector4f c_temp;
-				a_temp << view * cubes[m].T * Eigen::Vector4f(cubes[m].V(0, cubes[m].F(0, i)), cubes[m].V(1, cubes[m].F(0, i)), cubes[m].V(2, cubes[m].F(0, i)), 1);
-				b_temp << view * cubes[m].T * Eigen::Vector4f(cubes[m].V(0, cubes[m].F(1, i)), cubes[m].V(1, cubes[m].F(1, i)), cubes[m].V(2, cubes[m].F(1, i)), 1);
-				c_temp << view * cubes[m].T * Eigen::Vector4f(cubes[m].V(0, cubes[m].F(2, i)), cubes[m].V(1, cubes[m].F(2, i)), cubes[m].V(2, cubes[m].F(2, i)), 1);
-				Eigen::Vector3f a;
-				Eigen::Vector3f b;
-				Eigen::Vector3f c;
-				a << a_temp(0), a_temp(1), a_temp(2);
-				b << b_temp(0), b_temp(1), b_temp(2);
-				c << c_temp(0), c_temp(1), c_temp(2);
-				
-				// Compute intersection
-				Eigen::Matrix3f coeff;
-				coeff.col(0) = b - a;
-				coeff.col(1) = c - a;
-				coeff.col(2) = -ray_direction;
-
-				// std::cout << coeff << std::endl;
-				Eigen::Vector3f ans = coeff.inverse() * (ray_origin - a);
-				if (ans(0) >= 0 && ans(0) <= 1 && ans(1) >= 0 && ans(1) <= 1 && ans(0) + ans(1) >= 0 && ans(0) + ans(1) <= 1) {
-					intersection_found = true;
-					if (ans(2) < min_param) {
-						selected_obj = m;
-						min_param = ans(2);
-					}
-				}
-			}
-		}
-		if (!intersection_found) selected_obj = -1;
+		begin_drag(pick_cube(cubes, view, ray_origin, ray_direction));
 	}
-
-	// If no object is selected, then enable track ball
-	if (selected_obj == -1) {
-		if (action == GLFW_PRESS) {
-			glfwSetCursorPosCallback(window, cursor_pos_callback);
-			original_xcanonical = xcanonical;
-			original_ycanonical = ycanonical;
-			pressed = true;
+	else if (action == GLFW_RELEASE) {
+		if (pick_pending) {
+			// Quick click, finish it when the pick arrives
+			release_pending = true;
+			release_xcanonical = xcanonical;
+			release_ycanonical = ycanonical;
+			return;
 		}
-		else 
-			pressed = false;
+		end_drag(xcanonical, ycanonical);
 	}
-	// If one cube is selected, enable drag and rotate
-	else {
-		if (action == GLFW_PRESS) {
-			original_xcanonical = xcanonical;
-			original_ycanonical = ycanonical;
-		}
-		else {
-			if (action == GLFW_RELEASE) {
-				double x = xcanonical - original_xcanonical;
-				double y = ycanonical - original_ycanonical;
-
-				Eigen::MatrixXf view_original = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/4.0, Eigen::Vector3f::UnitX())).matrix() * 
-					Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/4.0, Eigen::Vector3f::UnitY())).matrix();
-				Eigen::MatrixXf view_transform = view * view_original.inverse();
+}
 
-				Eigen::Vector4f xy;
-				xy << x, y, 0, 1;
+////////////////////////////////////////////////////////////////////////////////
 
-				Eigen::Vector4f xy_temp = view_transform * xy;
+// Slow down (-) or speed up (=) the turns
+void key_callback_speed(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action == GLFW_RELEASE) {
+		player.duration *= key == GLFW_KEY_MINUS ? 1.5f : 1 / 1.5f;
+		player.duration = std::max(0.05f, std::min(player.duration, 5.0f));
+		std::cout << "Quarter turns take " << player.duration << "s" << std::endl;
+	}
+}
 
-				x = xy_temp(0);
-				y = xy_temp(1);
-				// std::cout << "(" << x << ", " << y << ")" << std::endl;
+// Switch between picking on the GPU and casting rays
+void key_callback_P(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action == GLFW_RELEASE && pick_buffer.supported) {
+		gpu_picking = !gpu_picking;
+		std::cout << (gpu_picking ? "Picking with the id buffer" : "Picking with rays") << std::endl;
+	}
+}
 
-				if (front_faces.find(selected_obj) != front_faces.end()) {
-					if (x * y <= 0 && abs(x) < abs(y)) {
-						rotation_options.push(x > 0 ? 0 : 6);
-						rotation_started.push(false);
-						return;
-					}
-				}
-				if (back_faces.find(selected_obj) != back_faces.end()) {
-					if (x * y <= 0 && abs(x) < abs(y)) {
-						rotation_options.push(x > 0 ? 7 : 1);
-						rotation_started.push(false);
-						return;
-					}
-				}
-				if (right_faces.find(selected_obj) != right_faces.end()) {
-					if (x * y > 0 && abs(x) < abs(y)) {
-						rotation_options.push(x > 0 ? 2 : 8);
-						rotation_started.push(false);
-						return;
-					}
-				}
-				if (left_faces.find(selected_obj) != left_faces.end()) {
-					if (x * y > 0 && abs(x) < abs(y)) {
-						rotation_options.push(x > 0 ? 9 : 3);
-						rotation_started.push(false);
-						return;
-					}
-				}
-				if (up_faces.find(selected_obj) != up_faces.end()) {
-					if (abs(x) > abs(y)) {
-						rotation_options.push(x > 0 ? 10 : 4);
-						rotation_started.push(false);
-						return;
-					}
-				}
-				if (down_faces.find(selected_obj) != down_faces.end()) {
-					if (abs(x) > abs(y)) {
-						rotation_options.push(x > 0 ? 5 : 11);
-						rotation_started.push(false);
-						return;
-					}
-				}
-			}
-		}
+// Start recording a trace, or write the one being recorded
+void key_callback_T(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action != GLFW_RELEASE) return;
+	if (trace_path.empty()) {
+		trace_path = "trace.json";
+	}
+	if (!tracing) {
+		trace_start();
+		std::cout << "Recording a trace, press T again to write it to " << trace_path << std::endl;
+	}
+	else if (trace_write(trace_path)) {
+		std::cout << "Trace written to " << trace_path << std::endl;
+	}
+	else {
+		std::cerr << "Could not write " << trace_path << std::endl;
 	}
-	// std::cout << selected_obj << std::endl;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	switch (key) {
 		case GLFW_KEY_1:
@@ -1407,6 +1096,30 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		case GLFW_KEY_SPACE:
 			key_callback_SPACE(window, key, scancode, action, mods);
 			break;	
+		case GLFW_KEY_O:
+			key_callback_O(window, key, scancode, action, mods);
+			break;
+		case GLFW_KEY_ESCAPE:
+			key_callback_ESCAPE(window, key, scancode, action, mods);
+			break;
+		case GLFW_KEY_P:
+			key_callback_P(window, key, scancode, action, mods);
+			break;
+		case GLFW_KEY_T:
+			key_callback_T(window, key, scancode, action, mods);
+			break;
+		case GLFW_KEY_M:
+		case GLFW_KEY_E:
+		case GLFW_KEY_S:
+		case GLFW_KEY_X:
+		case GLFW_KEY_Y:
+		case GLFW_KEY_Z:
+			key_callback_axis(window, key, scancode, action, mods);
+			break;
+		case GLFW_KEY_MINUS:
+		case GLFW_KEY_EQUAL:
+			key_callback_speed(window, key, scancode, action, mods);
+			break;
 		default:
 			break;
 	}
@@ -1414,73 +1127,50 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int main(int argc, char *argv[]) {
-	// Initialize the GLFW library
-	if (!glfwInit()) {
-		return -1;
-	}
-
-	// Activate supersampling
-	glfwWindowHint(GLFW_SAMPLES, 8);
-
-	// Ensure that we get at least a 3.2 context
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-
-	// On apple we have to load a core profile with forward compatibility
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-	// Create a windowed mode window and its OpenGL context
-	GLFWwindow * window = glfwCreateWindow(640, 640, "Interactive Rubik's Cube", NULL, NULL);
-	if (!window) {
-		glfwTerminate();
-		return -1;
-	}
-
-	// Make the window's context current
-	glfwMakeContextCurrent(window);
-
-	// Load OpenGL and its extensions
-	if (!gladLoadGL()) {
-		printf("Failed to load OpenGL and its extensions");
-		return(-1);
-	}
-	printf("OpenGL Version %d.%d loaded", GLVersion.major, GLVersion.minor);
-
-	int major, minor, rev;
-	major = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR);
-	minor = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR);
-	rev = glfwGetWindowAttrib(window, GLFW_CONTEXT_REVISION);
-	printf("OpenGL version recieved: %d.%d.%d\n", major, minor, rev);
-	printf("Supported OpenGL is %s\n", (const char*)glGetString(GL_VERSION));
-	printf("Supported GLSL is %s\n", (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
-
-	// Initialize the OpenGL Program
+// Compile the program drawing the cubes, load the sticker texture and upload
+// the mesh
+void init_renderer(Program &program, GLuint &texture, const std::string &texture_path) {
 	// A program controls the OpenGL pipeline and it must contains
-	// at least a vertex shader and a fragment shader to be valid
-	Program program;
-	const GLchar* vertex_shader = R"(
-		#version 150 core
-
-		uniform mat4 model;
+	// at least a vertex shader and a fragment shader to be valid.
+	// 6 texels per cube in the instance buffer: the model matrix, then the
+	// sticker tiles of the 6 faces
+	std::string vertex_shader = std::string("#version 150 core\n") + instance_model_shader + R"(
 		uniform mat4 view;
 		uniform mat4 proj;
 
 		in vec3 position;
-		in vec3 color;
 		in vec2 texCoord;
+		in float face;
 
 		out vec3 f_color;
 		out vec2 f_texCoord;
 
-		void main() {
-			gl_Position = proj * view * model * vec4(position, 1.0);
+		const vec3 face_colors[6] = vec3[6](
+			vec3(243, 243, 243) / 255.0,
+			vec3(240, 179, 42) / 255.0,
+			vec3(88, 128, 243) / 255.0,
+			vec3(50, 156, 88) / 255.0,
+			vec3(226, 112, 30) / 255.0,
+			vec3(221, 68, 51) / 255.0);
 
-			f_color = color;
-			f_texCoord = texCoord;
+		void main() {
+			gl_Position = proj * view * instance_model() * vec4(position, 1.0);
+			int f = int(face);
+			if (!face_visible(f)) gl_Position = hidden_position;
+
+			float tile = instance_tile(f);
+			if (tile < 0.0) {
+				// Black plastic
+				f_color = vec3(0.0);
+				f_texCoord = vec2(0.0);
+			}
+			else {
+				// The texture is a grid of 6 x 2 sticker tiles
+				float column = mod(tile, 6.0);
+				float row = floor(tile / 6.0);
+				f_color = face_colors[f];
+				f_texCoord = vec2((column + texCoord.x) / 6.0, 0.5 * (1.0 - row + texCoord.y));
+			}
 		}
 	)";
 
@@ -1508,8 +1198,12 @@ int main(int argc, char *argv[]) {
 	program.init(vertex_shader, fragment_shader, "outColor");
 	program.bind();
 
+	// The sticker texture uses unit 0, the instance buffer unit 1
+	glUniform1i(program.uniform("ourTexture"), 0);
+	glUniform1i(program.uniform("instances"), 1);
+	glUniform1i(program.uniform("face_cubes"), 2);
+
 	// Load and create a texture 
-    GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture); // All upcoming GL_TEXTURE_2D operations now have effect on this texture object
     // Set border color
@@ -1526,90 +1220,419 @@ int main(int argc, char *argv[]) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // Load image, create texture and generate mipmaps
     Image pixels;
-    if (argc == 1)
-    	load_image("../data/stickers.jpg", pixels);
-    else if (argc == 2)
-    	load_image(argv[1], pixels);
-    else 
-    	std::cout << "Usage: ./final-project OR ./final-project {JPEG file path}" << std::endl;
+    if (!load_image(texture_path, pixels))
+    	std::cerr << "Could not load " << texture_path << std::endl;
 
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pixels.rows(), pixels.cols(), 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
     glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture when done, so we won't accidentily mess up our texture.
 
+	init_mesh(program);
+}
+
+// Draw the puzzle into the bound framebuffer
+void draw_scene(Program &program, GLuint texture, int width, int height) {
+	// Set the size of the viewport (canvas) to the size of the framebuffer
+	glViewport(0, 0, width, height);
+	// Compute the aspect ratio
+	float aspect_ratio = float(height)/float(width); // corresponds to the necessary width scaling
+
+	// Clear the framebuffer
+	glClearColor(1.0f, 1.0f, 1.0f, 0.5f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Bind texture
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	proj(0, 0) = aspect_ratio;
+	// Enable depth test
+	glEnable(GL_DEPTH_TEST);
+	// Cull the faces turned away from the camera, the mesh is wound
+	// clockwise seen from outside
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glFrontFace(GL_CW);
+
+	glUniformMatrix4fv(program.uniform("proj"), 1, GL_FALSE, proj.data());
+	glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
+	set_turn_uniforms(program);
+
+	// Draw all the cubes with an instanced call per face
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, instance_texture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_BUFFER, face_cubes_texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	{
+		TRACE_SCOPE("draw");
+		mesh.vao.bind();
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		draw_cube_faces(program);
+		mesh.vao.unbind();
+	}
+}
+
+// Release the objects of init_renderer() and init_mesh()
+void free_renderer(Program &program, GLuint texture) {
+	program.free();
+	glDeleteTextures(1, &texture);
+	mesh.vao.free();
+	mesh.VERTICES_vbo.free();
+	mesh.F_vbo.free();
+	instance_vbo.free();
+	glDeleteTextures(1, &instance_texture);
+	face_cubes_vbo.free();
+	glDeleteTextures(1, &face_cubes_texture);
+}
+
+#ifdef RUBIK_HEADLESS
+// Render the puzzle without a window, once per scramble read from 'input'
+// (stdin if empty), as seen from the default view. Outputs are written to
+// 'output_dir' and named after the line of the scramble, blank lines and #
+// comments are skipped. With 'fps' at 0 a single image of the scrambled
+// puzzle is written, otherwise the frames of the scramble being played and
+// then of its solution (3x3x3 only).
+int run_headless(const std::string &texture_path, const std::string &input, const std::string &output_dir,
+	int width, int height, FrameFormat format, int fps)
+{
+	std::ifstream file;
+	if (!input.empty()) {
+		file.open(input);
+		if (!file.is_open()) {
+			std::cerr << "Could not open " << input << std::endl;
+			return 2;
+		}
+	}
+	std::istream &in = input.empty() ? std::cin : file;
+
+	if (!create_offscreen_context()) {
+		return -1;
+	}
+	if (!gladLoadGLLoader((GLADloadproc) offscreen_proc_address)) {
+		std::cerr << "Failed to load OpenGL and its extensions" << std::endl;
+		destroy_offscreen_context();
+		return -1;
+	}
+
+	Program program;
+	GLuint texture;
+	init_renderer(program, texture, texture_path);
+	program.bind();
+
+	// Multisampled like the window
+	OffscreenTarget target;
+	int written = 0;
+	int failures = 0;
+	if (target.init(width, height, 8)) {
+		// Frames are read back 3 frames late and encoded on all the cores
+		FrameExporter exporter;
+		exporter.init(target, 3, std::max(1u, std::thread::hardware_concurrency()));
+		auto render = [&]() {
+			target.bind();
+			draw_scene(program, texture, width, height);
+			exporter.capture(target);
+		};
+		auto frame_time = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+			std::chrono::duration<double>(fps > 0 ? 1.0 / fps : 0.0));
+		bool solve = fps > 0 && puzzle_size == 3;
+
+		std::string line;
+		int line_number = 0;
+		while (std::getline(in, line)) {
+			line_number++;
+			size_t start = line.find_first_not_of(" \t\r");
+			if (start == std::string::npos || line[start] == '#') continue;
+			std::vector<int> moves;
+			std::string token;
+			if (!parse_moves(line, moves, &token)) {
+				std::cerr << "Line " << line_number << ": invalid move '" << token << "'" << std::endl;
+				failures++;
+				continue;
+			}
+			char name[16];
+			snprintf(name, sizeof(name), "/%06d", line_number);
+			if (!exporter.begin(output_dir + name, format, fps, fps == 0)) {
+				std::cerr << "Could not write " << output_dir + name << std::endl;
+				failures++;
+				continue;
+			}
+
+			reset_cubes();
+			if (fps == 0) {
+				for (int m : moves) turn_cubes(cubes, puzzle_size, m);
+				update_transforms(cubes, puzzle_size);
+				update_instances();
+				render();
+			}
+			else {
+				// Frames of play() at a steady rate, the solution is queued
+				// once the scramble is played, like the SPACE key does
+				bool solution_queued = !solve;
+				auto clock = std::chrono::high_resolution_clock::now();
+				queue_moves(moves);
+				while (true) {
+					play(clock);
+					render();
+					if (!animating()) {
+						if (solution_queued) break;
+						solution_queued = true;
+						std::vector<int> solution;
+						if (!solver.ready && !solver.init(DATA_DIR "tables")) {
+							std::cerr << "Could not load the pruning tables, animations end after the scramble" << std::endl;
+							solve = false;
+						}
+						else if (solver.solve(cube_state.state, solution, 22)) {
+							queue_solution(solution);
+						}
+						if (!animating()) break;
+					}
+					clock += frame_time;
+				}
+			}
+			exporter.end();
+			written++;
+		}
+		if (!exporter.wait()) {
+			std::cerr << "Some frames could not be written" << std::endl;
+			failures++;
+		}
+		exporter.free();
+		target.free();
+	}
+	else {
+		failures++;
+	}
+	std::cerr << written << " scrambles rendered to " << output_dir << std::endl;
+
+	free_renderer(program, texture);
+	destroy_offscreen_context();
+	return failures > 0 ? 1 : 0;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[]) {
+	// Options, then the sticker texture
+	std::string texture_path = "../data/stickers.jpg";
+	bool texture_given = false;
+	std::string headless_dir;
+	std::string scrambles_path;
+	int width = 640, height = 640; // of the window or the images
+	std::string format_name = "ppm";
+	int fps = 0;
+	bool bad_args = false;
+	for (int i = 1; i < argc && !bad_args; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			puzzle_size = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+			headless_dir = argv[++i];
+		}
+		else if (strcmp(argv[i], "--scrambles") == 0 && i + 1 < argc) {
+			scrambles_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			format_name = argv[++i];
+		}
+		else if (strcmp(argv[i], "--animate") == 0 && i + 1 < argc) {
+			fps = atoi(argv[++i]);
+			if (fps < 1) {
+				bad_args = true;
+			}
+		}
+		else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 1 || height < 1) {
+				bad_args = true;
+			}
+		}
+		else if (argv[i][0] != '-' && !texture_given) {
+			texture_path = argv[i];
+			texture_given = true;
+		}
+		else {
+			bad_args = true;
+		}
+	}
+	if (bad_args || puzzle_size < MIN_PUZZLE_SIZE || puzzle_size > MAX_PUZZLE_SIZE) {
+		std::cout << "Usage: ./bin [--size N] [--trace FILE] [--resolution WxH] "
+			<< "[--headless DIR [--scrambles FILE] [--format ppm|png|y4m] [--animate FPS]] "
+			<< "[JPEG file path], with N from " << MIN_PUZZLE_SIZE << " to " << MAX_PUZZLE_SIZE << std::endl;
+		return 2;
+	}
+
+	// Spans of the main loop, the solvers and the texture load
+	trace_thread_name("main");
+	if (!trace_path.empty()) {
+		trace_start();
+	}
+
+	if (!headless_dir.empty()) {
+#ifdef RUBIK_HEADLESS
+		FrameFormat format;
+		if (!parse_frame_format(format_name, format)) {
+			std::cerr << "Unknown or unavailable format " << format_name << std::endl;
+			return 2;
+		}
+		int status = run_headless(texture_path, scrambles_path, headless_dir, width, height, format, fps);
+		if (tracing && !trace_write(trace_path)) {
+			std::cerr << "Could not write " << trace_path << std::endl;
+		}
+		return status;
+#else
+		std::cerr << "Built without EGL, --headless is not available" << std::endl;
+		return 2;
+#endif
+	}
+
+	// Initialize the GLFW library
+	if (!glfwInit()) {
+		return -1;
+	}
+
+	// Activate supersampling
+	glfwWindowHint(GLFW_SAMPLES, 8);
+
+	// Ensure that we get at least a 3.2 context
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+
+	// On apple we have to load a core profile with forward compatibility
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	// Create a windowed mode window and its OpenGL context
+	GLFWwindow * window = glfwCreateWindow(width, height, "Interactive Rubik's Cube", NULL, NULL);
+	if (!window) {
+		glfwTerminate();
+		return -1;
+	}
+
+	// Make the window's context current
+	glfwMakeContextCurrent(window);
+
+	// Wait for the vertical blank, animations then run at the refresh rate
+	glfwSwapInterval(1);
+
+	// Load OpenGL and its extensions
+	if (!gladLoadGL()) {
+		printf("Failed to load OpenGL and its extensions");
+		return(-1);
+	}
+	printf("OpenGL Version %d.%d loaded", GLVersion.major, GLVersion.minor);
+
+	int major, minor, rev;
+	major = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR);
+	minor = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR);
+	rev = glfwGetWindowAttrib(window, GLFW_CONTEXT_REVISION);
+	printf("OpenGL version recieved: %d.%d.%d\n", major, minor, rev);
+	printf("Supported OpenGL is %s\n", (const char*)glGetString(GL_VERSION));
+	printf("Supported GLSL is %s\n", (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+	// The program drawing the cubes and the sticker texture
+	Program program;
+	GLuint texture;
+	init_renderer(program, texture, texture_path);
 
 	// Register the keyboard callback
 	glfwSetKeyCallback(window, key_callback);
 
-	// Register the mouse callback
+	// Register the mouse callbacks, the cursor only turns the view while dragging
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
+	glfwSetCursorPosCallback(window, cursor_pos_callback);
 
+	// Register the refresh callback, called when the window needs a new frame
+	glfwSetWindowRefreshCallback(window, window_refresh_callback);
+
+	init_pick_buffer();
+	program.bind();
 	reset_cubes();
 
 	// Loop until the user closes the window
 	while (!glfwWindowShouldClose(window)) {
-		// Set the size of the viewport (canvas) to the size of the application window (framebuffer)
-		int width, height;
-		glfwGetFramebufferSize(window, &width, &height);
-		glViewport(0, 0, width, height);
-		// Compute the aspect ratio
-		float aspect_ratio = float(height)/float(width); // corresponds to the necessary width scaling
-
-		// Clear the framebuffer
-		glClearColor(1.0f, 1.0f, 1.0f, 0.5f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// Bind texture
-		glBindTexture(GL_TEXTURE_2D, texture);
-
-		proj(0, 0) = aspect_ratio;
-		// Enable depth test
-		glEnable(GL_DEPTH_TEST);
-		{
-			glUniformMatrix4fv(program.uniform("proj"), 1, GL_FALSE, proj.data());
-			glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
-
-
-			for (int c = 0; c < cubes.size(); c++) {
-				cubes[c].vao.bind();
-				program.bindVertexAttribArray("position", cubes[c].V_vbo);
-				program.bindVertexAttribArray("color", cubes[c].C_vbo);
-				program.bindVertexAttribArray("texCoord", cubes[c].T_vbo);
-				 
-				glUniformMatrix4fv(program.uniform("model"), 1, GL_FALSE, cubes[c].T.data());
+#ifdef RUBIK_COUNT_ALLOCATIONS
+		size_t allocations = allocation_count();
+#endif
+		// Pick up the result of a background solve
+		poll_solve_job(window);
 
+		// Enable animation play
+		{
+			TRACE_SCOPE("play");
+			play(std::chrono::high_resolution_clock::now());
+		}
 
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		if (redraw || animating()) {
+			TRACE_SCOPE("frame");
+			redraw = false;
 
-				glDrawElements(GL_TRIANGLES, 3 * cubes[c].F.cols(), cubes[c].F_vbo.scalar_type, 0);
-				cubes[c].vao.unbind();
-			}
-			
-			// Set the uniform value depending on the time difference
-			auto t_now = std::chrono::high_resolution_clock::now();
+			// Set the size of the viewport (canvas) to the size of the application window (framebuffer)
+			int width, height;
+			glfwGetFramebufferSize(window, &width, &height);
+			draw_scene(program, texture, width, height);
 
-			// Enable animation play
-			play();
+			// Ids of the clicked pixel, read back a frame or so later
+			render_pick(program, width, height);
 
-			glUniform3f(program.uniform("triangleColor"), 0.0f, 0.0f, 0.0f);
+			// Swap front and back buffers
+			TRACE_SCOPE("swap_buffers");
+			glfwSwapBuffers(window);
 		}
+		poll_pick();
+
+#ifdef RUBIK_COUNT_ALLOCATIONS
+		// The first frame warms up the driver, the ones after it should not
+		// touch the heap. Input callbacks run below and are not counted.
+		allocations = allocation_count() - allocations;
+		if (frames++ > 0 && allocations > 0) {
+			frames_allocating++;
+			std::cerr << "Frame " << frames << ": " << allocations << " allocations" << std::endl;
+		}
+#endif
 
-		// Swap front and back buffers
-		glfwSwapBuffers(window);
-
-		// Poll for and process events
-		glfwPollEvents();
+		// Process events. Frames are drawn at the refresh rate only while a turn
+		// plays, otherwise the loop sleeps until something happens: an input,
+		// the id of a click, or the progress of a background solve.
+		TRACE_SCOPE("events");
+		if (animating()) {
+			glfwPollEvents();
+		}
+		else if (pick_pending) {
+			glfwWaitEventsTimeout(0.002);
+		}
+		else if (solve_job.active()) {
+			glfwWaitEventsTimeout(0.1);
+		}
+		else {
+			glfwWaitEvents();
+		}
 	}
 
 	// Deallocate opengl memory
-	program.free();
-	for (int c = 0; c < 27; c++) {
-		cubes[c].vao.free();
-		cubes[c].V_vbo.free();
-		cubes[c].C_vbo.free();
-		cubes[c].T_vbo.free();
-		cubes[c].F_vbo.free();
+	free_renderer(program, texture);
+	free_pick_buffer();
+	// Stop the background solve before releasing the solver tables and workers
+	solve_job.cancel();
+	solve_job.join();
+	solver.free();
+	optimal_solver.free();
+	if (tracing) {
+		if (trace_write(trace_path)) {
+			std::cout << "Trace written to " << trace_path << std::endl;
+		}
+		else {
+			std::cerr << "Could not write " << trace_path << std::endl;
+		}
 	}
+#ifdef RUBIK_COUNT_ALLOCATIONS
+	std::cerr << frames_allocating << " of " << frames << " frames allocated" << std::endl;
+#endif
 	// Deallocate glfw internals
 	glfwTerminate();
 	return 0;
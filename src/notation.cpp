@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "notation.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Letters in the order of the move axes: the faces (FR, BA, RI, LE, UP, DO),
+// the slices and the cube rotations
+const char axis_letters[] = "FBRLUDMESxyz";
+
+// Suffix of each number of quarter turns
+const char *turn_suffixes[3] = {"", "2", "'"};
+
+}
+
+bool parse_moves(const std::string &text, std::vector<int> &moves, std::string *error) {
+	moves.clear();
+	std::istringstream in(text);
+	std::string token;
+	while (in >> token) {
+		const char *face = token.size() > 0 ? strchr(axis_letters, token[0]) : NULL;
+		int turns = -1;
+		if (face && *face) {
+			std::string suffix = token.substr(1);
+			for (int t = 0; t < 3; t++) {
+				if (suffix == turn_suffixes[t]) turns = t;
+			}
+		}
+		if (turns < 0) {
+			if (error) *error = token;
+			return false;
+		}
+		moves.push_back((face - axis_letters) * 3 + turns);
+	}
+	return true;
+}
+
+std::string format_moves(const std::vector<int> &moves) {
+	std::string text;
+	for (size_t i = 0; i < moves.size(); i++) {
+		if (i > 0) text += ' ';
+		text += axis_letters[moves[i] / 3];
+		text += turn_suffixes[moves[i] % 3];
+	}
+	return text;
+}
+
+void simplify_moves(std::vector<int> &moves) {
+	// 'out' never holds two moves around the same axis in a row, nor three
+	// opposite face turns, so every move only needs the last two
+	std::vector<int> out;
+	for (int m : moves) {
+		int axis = m / 3;
+		int turns = m % 3 + 1;
+		int n = out.size();
+		// Opposite face turns only, slices and rotations share no layer
+		bool opposite = axis < 6 && n > 0 && out[n - 1] / 3 == (axis ^ 1);
+		int i = -1; // move around the same axis to merge with
+		if (n > 0 && out[n - 1] / 3 == axis) {
+			i = n - 1;
+		}
+		else if (opposite && n > 1 && out[n - 2] / 3 == axis) {
+			i = n - 2;
+		}
+		if (i >= 0) {
+			turns = (turns + out[i] % 3 + 1) % 4;
+			if (turns == 0) out.erase(out.begin() + i);
+			else out[i] = axis * 3 + turns - 1;
+			continue;
+		}
+		out.push_back(m);
+		// Opposite faces in canonical order
+		if (opposite && axis < out[n - 1] / 3) {
+			std::swap(out[n - 1], out[n]);
+		}
+	}
+	moves.swap(out);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "cube_state.h"
+#include <string>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard notation: a face letter (F, B, R, L, U, D), a slice letter (M, E,
+// S) or a cube rotation (x, y, z) followed by nothing for a clockwise quarter
+// turn, ' for a counter clockwise one and 2 for a half turn. Moves are
+// separated by white space, e.g. "R U2 M' x".
+
+// Parse a sequence of moves (see move_axis, face turns come first).
+// On failure returns false and stores the offending token in 'error'.
+bool parse_moves(const std::string &text, std::vector<int> &moves, std::string *error = NULL);
+
+// Format moves, separated by single spaces
+std::string format_moves(const std::vector<int> &moves);
+
+// Shorten a sequence of moves without changing its effect: moves around the
+// same axis are merged (R R -> R2, R R R -> R', M M -> M2), identities
+// removed (R R' -> nothing) and opposite face turns, which commute, are put
+// in FBRLUD order so that turns separated by their opposite are merged too
+// (R L R -> R2 L).
+void simplify_moves(std::vector<int> &moves);
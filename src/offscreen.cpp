@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "offscreen.h"
+#include "helpers.h"
+// EGL without the X11 types, only the surfaceless and default displays are used
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+EGLDisplay display = EGL_NO_DISPLAY;
+EGLContext context = EGL_NO_CONTEXT;
+
+bool has_extension(const char *extensions, const char *name) {
+	if (!extensions) return false;
+	size_t length = strlen(name);
+	for (const char *p = strstr(extensions, name); p; p = strstr(p + length, name)) {
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) return true;
+	}
+	return false;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool create_offscreen_context() {
+	// The client extensions tell whether the surfaceless platform exists
+	const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (get_platform_display && has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		std::cerr << "Could not open an EGL display" << std::endl;
+		display = EGL_NO_DISPLAY;
+		return false;
+	}
+	if (!has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		std::cerr << "EGL cannot make a context current without a surface" << std::endl;
+		destroy_offscreen_context();
+		return false;
+	}
+
+	// Any surface type, the default only takes window configurations
+	const EGLint config_attributes[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, 0,
+		EGL_NONE
+	};
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_configs = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, config_attributes, &config, 1, &num_configs)
+		|| num_configs == 0)
+	{
+		std::cerr << "EGL has no OpenGL configuration" << std::endl;
+		destroy_offscreen_context();
+		return false;
+	}
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		std::cerr << "Could not create an OpenGL 3.2 context with EGL" << std::endl;
+		destroy_offscreen_context();
+		return false;
+	}
+	return true;
+}
+
+void destroy_offscreen_context() {
+	if (display == EGL_NO_DISPLAY) return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT) {
+		eglDestroyContext(display, context);
+		context = EGL_NO_CONTEXT;
+	}
+	eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+}
+
+void *offscreen_proc_address(const char *name) {
+	return (void *) eglGetProcAddress(name);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool OffscreenTarget::init(int w, int h, int max_samples) {
+	GLint max_size, max_viewport[2], driver_samples;
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_size);
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+	glGetIntegerv(GL_MAX_SAMPLES, &driver_samples);
+	if (w < 1 || h < 1 || w > std::min(max_size, max_viewport[0]) || h > std::min(max_size, max_viewport[1])) {
+		std::cerr << "The size is out of the driver limits (" << std::min(max_size, max_viewport[0]) << " x "
+			<< std::min(max_size, max_viewport[1]) << ")" << std::endl;
+		return false;
+	}
+	width = w;
+	height = h;
+	samples = std::max(0, std::min(max_samples, (int) driver_samples));
+
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(1, &color);
+	glGenRenderbuffers(1, &depth);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glGenFramebuffers(1, &resolve_fbo);
+	glGenRenderbuffers(1, &resolve_color);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, resolve_color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolve_color);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	check_gl_error();
+	if (!complete) {
+		std::cerr << "Could not create a " << width << " x " << height << " framebuffer" << std::endl;
+		free();
+	}
+	return complete;
+}
+
+void OffscreenTarget::bind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void OffscreenTarget::resolve() {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo);
+}
+
+void OffscreenTarget::free() {
+	glDeleteRenderbuffers(1, &color);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteRenderbuffers(1, &resolve_color);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteFramebuffers(1, &resolve_fbo);
+	fbo = color = depth = resolve_fbo = resolve_color = 0;
+}
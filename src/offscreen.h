@@ -0,0 +1,54 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include <glad/glad.h>
+////////////////////////////////////////////////////////////////////////////////
+
+// Rendering without a window, for --headless: an EGL context with no surface,
+// on Mesa's surfaceless platform when available so that neither a display
+// server nor a GPU is needed, drawing into a framebuffer object.
+
+// Create an OpenGL 3.2 core context and make it current, false if EGL has
+// no display or refuses the context
+bool create_offscreen_context();
+
+// Release the context and the display
+void destroy_offscreen_context();
+
+// Address of a GL function, to load glad with
+void *offscreen_proc_address(const char *name);
+
+// -----------------------------------------------------------------------------
+
+// Multisampled color and depth buffers, resolved into a single sample color
+// buffer to be read back
+class OffscreenTarget {
+public:
+	int width;
+	int height;
+	int samples;
+
+	GLuint fbo; // multisampled, drawn into
+	GLuint color;
+	GLuint depth;
+	GLuint resolve_fbo; // single sample, read from
+	GLuint resolve_color;
+
+	OffscreenTarget()
+		: width(0), height(0), samples(0), fbo(0), color(0), depth(0), resolve_fbo(0), resolve_color(0)
+	{ }
+
+	// Create the buffers, with up to 'max_samples' samples per pixel. False
+	// if the size is beyond the limits of the driver.
+	bool init(int w, int h, int max_samples);
+
+	// Draw the next calls into the target
+	void bind();
+
+	// Resolve the samples, and leave the single sample buffer bound for
+	// reading
+	void resolve();
+
+	// Release the buffers
+	void free();
+};
@@ -0,0 +1,349 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "optimal.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+////////////////////////////////////////////////////////////////////////////////
+
+const char *corner_pdb_file = "corners.pdb";
+const char *edge_pdb_files[2] = {"edges0.pdb", "edges1.pdb"};
+
+namespace {
+
+// Entries not reached yet while a database is generated
+const uint8_t unvisited = 0xf;
+
+// Where a single edge goes under each move, locations are slot * 2 + orientation
+struct EdgeLocationMoves {
+	uint8_t next[NUM_EDGES * 2][NUM_MOVES];
+
+	EdgeLocationMoves() {
+		for (int m = 0; m < NUM_MOVES; m++) {
+			CubeState state;
+			state.move(m);
+			for (int i = 0; i < NUM_EDGES; i++) {
+				for (int o = 0; o < 2; o++) {
+					next[state.ep[i] * 2 + o][m] = i * 2 + (o ^ state.eo[i]);
+				}
+			}
+		}
+	}
+};
+
+const EdgeLocationMoves &edge_location_moves() {
+	static const EdgeLocationMoves moves;
+	return moves;
+}
+
+// Corner move tables over all 18 moves
+void build_corner_move_tables(std::vector<uint16_t> &corners_move, std::vector<uint16_t> &twist_move) {
+	int all_moves[NUM_MOVES];
+	for (int m = 0; m < NUM_MOVES; m++) all_moves[m] = m;
+	build_move_table(corners_move, N_CORNERS, set_corners, corners_coord, all_moves, NUM_MOVES);
+	build_move_table(twist_move, N_TWIST, set_twist, twist_coord, all_moves, NUM_MOVES);
+}
+
+// Run fn(begin, end) over chunks of [0, n) on the pool and wait for all of them
+void parallel_for(Eigen::NonBlockingThreadPool &pool, uint64_t n,
+	const std::function<void(uint64_t, uint64_t)> &fn)
+{
+	const uint64_t chunk = 1 << 16;
+	std::mutex mutex;
+	std::condition_variable finished;
+	uint64_t pending = (n + chunk - 1) / chunk;
+	for (uint64_t begin = 0; begin < n; begin += chunk) {
+		pool.Schedule([&, begin]() {
+			fn(begin, std::min(begin + chunk, n));
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0) {
+				finished.notify_one();
+			}
+		});
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [&]() { return pending == 0; });
+}
+
+// Location of every edge of a state
+void edge_locations(const CubeState &state, uint8_t *loc) {
+	for (int s = 0; s < NUM_EDGES; s++) {
+		loc[state.ep[s]] = s * 2 + state.eo[s];
+	}
+}
+
+// Rank the locations of the 6 edges of a group
+uint32_t edge_rank(const uint8_t *loc) {
+	uint32_t r = 0;
+	unsigned used = 0, ori = 0;
+	for (int i = 0; i < EDGE_GROUP_SIZE; i++) {
+		int slot = loc[i] >> 1;
+		r = r * (NUM_EDGES - i) + slot - __builtin_popcount(used & ((1u << slot) - 1));
+		used |= 1u << slot;
+		ori |= (loc[i] & 1u) << i;
+	}
+	return r * 64 + ori;
+}
+
+// Inverse of edge_rank
+void edge_unrank(uint32_t idx, uint8_t *loc) {
+	unsigned ori = idx & 63;
+	uint32_t r = idx >> 6;
+	int digit[EDGE_GROUP_SIZE];
+	for (int i = EDGE_GROUP_SIZE - 1; i >= 0; i--) {
+		digit[i] = r % (NUM_EDGES - i);
+		r /= NUM_EDGES - i;
+	}
+	unsigned used = 0;
+	for (int i = 0; i < EDGE_GROUP_SIZE; i++) {
+		// Take the digit-th free slot
+		int slot = 0;
+		for (int k = digit[i]; ; slot++) {
+			if (used & (1u << slot)) continue;
+			if (k-- == 0) break;
+		}
+		used |= 1u << slot;
+		loc[i] = slot * 2 + ((ori >> i) & 1);
+	}
+}
+
+// A node of the search, with the coordinates needed by the databases
+struct Node {
+	uint16_t corners;
+	uint16_t twist;
+	uint8_t loc[NUM_EDGES];
+};
+
+// A node below the first plies, searched by a single worker
+struct Subtree {
+	Node node;
+	int h;
+	int depth;
+	int path[SPLIT_DEPTH];
+};
+
+// State of the search of one subtree
+struct Search {
+	const OptimalSolver &s;
+	const EdgeLocationMoves &edge_moves;
+	const std::atomic<bool> &stop; // set once any worker found a solution
+	const SolveControl *control;
+	int path[32];
+
+	Search(const OptimalSolver &solver, const std::atomic<bool> &found, const SolveControl *c)
+		: s(solver), edge_moves(edge_location_moves()), stop(found), control(c) { }
+
+	int heuristic(const Node &n) const {
+		int h = s.corner_pdb.get((uint64_t) n.corners * N_TWIST + n.twist);
+		h = std::max<int>(h, s.edge_pdb[0].get(edge_rank(n.loc)));
+		h = std::max<int>(h, s.edge_pdb[1].get(edge_rank(n.loc + EDGE_GROUP_SIZE)));
+		return h;
+	}
+
+	Node child(const Node &n, int m) const {
+		Node c;
+		c.corners = s.corners_move[n.corners * NUM_MOVES + m];
+		c.twist = s.twist_move[n.twist * NUM_MOVES + m];
+		for (int e = 0; e < NUM_EDGES; e++) {
+			c.loc[e] = edge_moves.next[n.loc[e]][m];
+		}
+		return c;
+	}
+
+	// Depth-first search below the bound; every database at zero means solved
+	bool dfs(const Node &n, int h, int depth, int bound) {
+		if (h == 0) return true;
+		if (stop.load(std::memory_order_relaxed) || (control && control->cancelled())) return false;
+		int last_face = depth > 0 ? path[depth - 1] / 3 : -1;
+		for (int m = 0; m < NUM_MOVES; m++) {
+			if (redundant_face(m / 3, last_face)) continue;
+			Node child = this->child(n, m);
+			int child_h = heuristic(child);
+			if (depth + 1 + child_h > bound) continue;
+			path[depth] = m;
+			if (dfs(child, child_h, depth + 1, bound)) return true;
+		}
+		return false;
+	}
+
+	// Collect the nodes at split_depth that fit under the bound, with the
+	// moves leading to them
+	void expand(const Node &n, int h, int depth, int split_depth, int bound, std::vector<Subtree> &out) {
+		if (depth == split_depth || h == 0) {
+			Subtree t;
+			t.node = n;
+			t.h = h;
+			t.depth = depth;
+			std::copy(path, path + depth, t.path);
+			out.push_back(t);
+			return;
+		}
+		int last_face = depth > 0 ? path[depth - 1] / 3 : -1;
+		for (int m = 0; m < NUM_MOVES; m++) {
+			if (redundant_face(m / 3, last_face)) continue;
+			Node child = this->child(n, m);
+			int child_h = heuristic(child);
+			if (depth + 1 + child_h > bound) continue;
+			path[depth] = m;
+			expand(child, child_h, depth + 1, split_depth, bound, out);
+		}
+	}
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t corner_pdb_index(const CubeState &state) {
+	return (uint64_t) corners_coord(state) * N_TWIST + twist_coord(state);
+}
+
+uint32_t edge_pdb_index(const CubeState &state, int group) {
+	uint8_t loc[NUM_EDGES];
+	edge_locations(state, loc);
+	return edge_rank(loc + group * EDGE_GROUP_SIZE);
+}
+
+// Both generators expand one depth at a time: every entry at the current
+// depth is scanned in parallel and its neighbours claimed with an atomic
+// compare-and-set, so each entry is counted exactly once.
+
+void generate_corner_pdb(PatternDatabase &pdb, Eigen::NonBlockingThreadPool &pool) {
+	std::vector<uint16_t> corners_move, twist_move;
+	build_corner_move_tables(corners_move, twist_move);
+
+	pdb.init(N_CORNER_PDB, unvisited);
+	pdb.set(corner_pdb_index(CubeState()), 0);
+	uint64_t count = 1;
+	for (int depth = 0; count < N_CORNER_PDB; depth++) {
+		std::atomic<uint64_t> found(0);
+		parallel_for(pool, N_CORNER_PDB, [&](uint64_t begin, uint64_t end) {
+			uint64_t local = 0;
+			for (uint64_t i = begin; i < end; i++) {
+				if (pdb.atomic_get(i) != depth) continue;
+				int corners = i / N_TWIST;
+				int twist = i % N_TWIST;
+				for (int m = 0; m < NUM_MOVES; m++) {
+					uint64_t n = (uint64_t) corners_move[corners * NUM_MOVES + m] * N_TWIST + twist_move[twist * NUM_MOVES + m];
+					if (pdb.compare_and_set(n, unvisited, depth + 1)) local++;
+				}
+			}
+			found += local;
+		});
+		count += found;
+		std::cout << "Corner database: depth " << depth + 1 << ", " << count << " states" << std::endl;
+	}
+}
+
+void generate_edge_pdb(PatternDatabase &pdb, int group, Eigen::NonBlockingThreadPool &pool) {
+	const EdgeLocationMoves &moves = edge_location_moves();
+	pdb.init(N_EDGE_PDB, unvisited);
+	pdb.set(edge_pdb_index(CubeState(), group), 0);
+	uint64_t count = 1;
+	for (int depth = 0; count < N_EDGE_PDB; depth++) {
+		std::atomic<uint64_t> found(0);
+		parallel_for(pool, N_EDGE_PDB, [&](uint64_t begin, uint64_t end) {
+			uint64_t local = 0;
+			for (uint64_t i = begin; i < end; i++) {
+				if (pdb.atomic_get(i) != depth) continue;
+				uint8_t loc[EDGE_GROUP_SIZE], next[EDGE_GROUP_SIZE];
+				edge_unrank(i, loc);
+				for (int m = 0; m < NUM_MOVES; m++) {
+					for (int e = 0; e < EDGE_GROUP_SIZE; e++) {
+						next[e] = moves.next[loc[e]][m];
+					}
+					if (pdb.compare_and_set(edge_rank(next), unvisited, depth + 1)) local++;
+				}
+			}
+			found += local;
+		});
+		count += found;
+		std::cout << "Edge database " << group << ": depth " << depth + 1 << ", " << count << " states" << std::endl;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool OptimalSolver::init(const std::string &dir, int num_threads) {
+	if (num_threads <= 0) {
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	delete pool;
+	pool = new Eigen::NonBlockingThreadPool(num_threads);
+	build_corner_move_tables(corners_move, twist_move);
+
+	ready = load_table(corner_pdb, dir + "/" + corner_pdb_file, N_CORNER_PDB);
+	for (int g = 0; g < 2; g++) {
+		ready = ready && load_table(edge_pdb[g], dir + "/" + edge_pdb_files[g], N_EDGE_PDB);
+	}
+	return ready;
+}
+
+void OptimalSolver::free() {
+	corner_pdb.free();
+	edge_pdb[0].free();
+	edge_pdb[1].free();
+	delete pool;
+	pool = NULL;
+	ready = false;
+}
+
+bool OptimalSolver::solve(const CubeState &state, std::vector<int> &solution, int max_length,
+	SolveControl *control) const
+{
+	assert(ready);
+	assert(max_length < 32);
+	solution.clear();
+
+	Node root;
+	root.corners = corners_coord(state);
+	root.twist = twist_coord(state);
+	edge_locations(state, root.loc);
+
+	std::atomic<bool> found(false);
+	Search search(*this, found, control);
+	int h = search.heuristic(root);
+	if (h == 0) return true;
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	for (int bound = h; bound <= max_length; bound++) {
+		if (control) {
+			if (control->cancelled()) return false;
+			control->depth = bound;
+		}
+		TRACE_SCOPE("optimal_bound");
+		// Every subtree becomes a task; the pool balances them across workers
+		// and the ones queued after a solution was found return right away
+		std::vector<Subtree> subtrees;
+		search.expand(root, h, 0, std::min(SPLIT_DEPTH, bound), bound, subtrees);
+		size_t pending = subtrees.size();
+		for (size_t i = 0; i < subtrees.size(); i++) {
+			pool->Schedule([&, i, bound]() {
+				TRACE_SCOPE("subtree");
+				const Subtree &t = subtrees[i];
+				Search worker(*this, found, control);
+				std::copy(t.path, t.path + t.depth, worker.path);
+				bool solved = worker.dfs(t.node, t.h, t.depth, bound);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (solved && !found) {
+					solution.assign(worker.path, worker.path + bound);
+					found = true;
+				}
+				if (--pending == 0) {
+					finished.notify_one();
+				}
+			});
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [&]() { return pending == 0; });
+		if (found) return true;
+	}
+	return false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "coordinates.h"
+#include "pattern_database.h"
+#include "solve_control.h"
+#include <unsupported/Eigen/CXX11/ThreadPool>
+#include <string>
+////////////////////////////////////////////////////////////////////////////////
+
+// Pattern database sizes
+#define N_CORNER_PDB 88179840ULL // 8! * 3^7 corner permutations and orientations
+#define N_EDGE_ARRANGEMENTS 665280 // 12 * 11 * 10 * 9 * 8 * 7 placements of 6 edges
+#define N_EDGE_PDB (N_EDGE_ARRANGEMENTS * 64ULL) // placements times the 2^6 orientations of 6 edges
+
+// Edges tracked by each edge database: group 0 holds UR..DF, group 1 DL..BR
+#define EDGE_GROUP_SIZE 6
+
+// Plies expanded before the subtrees are handed to the worker threads
+#define SPLIT_DEPTH 3
+
+// -----------------------------------------------------------------------------
+
+// Korf's optimal solver: IDA* guided by a database of all corner states and
+// two databases of 6 edges each. Solutions are minimal in the half-turn metric.
+class OptimalSolver {
+public:
+	// Corner move tables over all 18 moves [coordinate * NUM_MOVES + move]
+	std::vector<uint16_t> corners_move;
+	std::vector<uint16_t> twist_move;
+
+	// Distance to solved of every corner state and of every state of each edge group
+	PatternDatabase corner_pdb;
+	PatternDatabase edge_pdb[2];
+
+	// Workers searching the subtrees below SPLIT_DEPTH, idle ones steal queued subtrees
+	Eigen::NonBlockingThreadPool *pool;
+
+	// True once the databases are available
+	bool ready;
+
+	OptimalSolver() : pool(NULL), ready(false) { }
+
+	// Map the databases from the files in 'dir', written by generate_tables.
+	// The search runs on 'num_threads' workers, all hardware threads by default.
+	bool init(const std::string &dir, int num_threads = 0);
+
+	// Release the databases and stop the workers
+	void free();
+
+	// Find a shortest solution, if there is one of at most max_length moves.
+	// Returns false when cancelled through 'control'.
+	bool solve(const CubeState &state, std::vector<int> &solution, int max_length = 20,
+		SolveControl *control = NULL) const;
+};
+
+// -----------------------------------------------------------------------------
+
+// Index of a state in the corner database
+uint64_t corner_pdb_index(const CubeState &state);
+
+// Index of a state in the database of an edge group
+uint32_t edge_pdb_index(const CubeState &state, int group);
+
+// Breadth-first generation of the databases, spread over the workers of 'pool'
+void generate_corner_pdb(PatternDatabase &pdb, Eigen::NonBlockingThreadPool &pool);
+void generate_edge_pdb(PatternDatabase &pdb, int group, Eigen::NonBlockingThreadPool &pool);
+
+// File names of the databases inside the table directory
+extern const char *corner_pdb_file;
+extern const char *edge_pdb_files[2];
@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "pattern_database.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const char magic[4] = {'R', 'P', 'D', 'B'};
+
+}
+
+uint64_t PatternDatabase::checksum(const uint8_t *data, size_t bytes) {
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < bytes; i++) {
+		h = (h ^ data[i]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+void PatternDatabase::init(uint64_t n, uint8_t value) {
+	free();
+	size = n;
+	storage.assign(bytes(n), value | (value << 4));
+	data = storage.data();
+}
+
+bool PatternDatabase::load(const std::string &path, uint64_t n) {
+	free();
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (uint64_t) st.st_size != sizeof(PatternDatabaseHeader) + bytes(n)) {
+		close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return false;
+	}
+	const PatternDatabaseHeader *header = static_cast<const PatternDatabaseHeader *>(p);
+	const uint8_t *entries = static_cast<const uint8_t *>(p) + sizeof(PatternDatabaseHeader);
+	if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != PDB_FORMAT_VERSION
+		|| header->size != n || header->checksum != checksum(entries, bytes(n)))
+	{
+		munmap(p, st.st_size);
+		return false;
+	}
+	// Lookups during the search are scattered all over the table
+	madvise(p, st.st_size, MADV_RANDOM);
+
+	mapping = p;
+	mapping_size = st.st_size;
+	size = n;
+	data = entries;
+	return true;
+}
+
+bool PatternDatabase::save(const std::string &path) const {
+	// Write to a temporary file first so a crash never leaves a truncated table
+	std::string tmp = path + ".tmp";
+	std::ofstream file(tmp, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	PatternDatabaseHeader header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = PDB_FORMAT_VERSION;
+	header.size = size;
+	header.checksum = checksum(data, bytes(size));
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(data), bytes(size));
+	file.close();
+	return !file.fail() && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void PatternDatabase::free() {
+	if (mapping) {
+		munmap(mapping, mapping_size);
+		mapping = NULL;
+		mapping_size = 0;
+	}
+	storage.clear();
+	storage.shrink_to_fit();
+	size = 0;
+	data = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool load_table(PatternDatabase &pdb, const std::string &path, uint64_t n) {
+	if (pdb.load(path, n)) {
+		return true;
+	}
+	std::cerr << "Missing or invalid table " << path << ", run generate_tables to build it" << std::endl;
+	return false;
+}
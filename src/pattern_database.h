@@ -0,0 +1,91 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Bumped whenever the layout of a table changes, older files are rejected
+#define PDB_FORMAT_VERSION 1
+
+// Header at the start of every table file, followed by the packed entries
+struct PatternDatabaseHeader {
+	char magic[4];     // "RPDB"
+	uint32_t version;  // PDB_FORMAT_VERSION
+	uint64_t size;     // number of entries
+	uint64_t checksum; // FNV-1a hash of the packed entries
+};
+
+// -----------------------------------------------------------------------------
+
+// A table of 4-bit entries (two per byte, low nibble first). It is either
+// built in memory or mapped read-only from a file, so that several processes
+// share one copy through the page cache.
+class PatternDatabase {
+public:
+	uint64_t size;       // number of entries
+	const uint8_t *data; // packed entries
+
+	PatternDatabase() : size(0), data(NULL), mapping(NULL), mapping_size(0) { }
+
+	// Allocate a table of n entries in memory, all set to 'value'
+	void init(uint64_t n, uint8_t value);
+
+	// Map a table of n entries from a file. Returns false if the file is
+	// missing, from another format version or corrupted.
+	bool load(const std::string &path, uint64_t n);
+
+	// Write the header and the packed entries to a file
+	bool save(const std::string &path) const;
+
+	// Release the memory or the mapping
+	void free();
+
+	// Number of bytes holding n entries
+	static size_t bytes(uint64_t n) { return (n + 1) / 2; }
+
+	// Hash of the packed entries stored in the header
+	static uint64_t checksum(const uint8_t *data, size_t bytes);
+
+	uint8_t get(uint64_t i) const {
+		return (data[i >> 1] >> ((i & 1) << 2)) & 0xf;
+	}
+
+	// Only valid for tables built in memory
+	void set(uint64_t i, uint8_t value) {
+		uint8_t &b = storage[i >> 1];
+		int shift = (i & 1) << 2;
+		b = (b & ~(0xf << shift)) | (value << shift);
+	}
+
+	// Atomic versions of get and set for tables filled by several threads.
+	// compare_and_set only writes if the entry still holds 'expected'.
+	uint8_t atomic_get(uint64_t i) const {
+		uint8_t b = __atomic_load_n(&data[i >> 1], __ATOMIC_RELAXED);
+		return (b >> ((i & 1) << 2)) & 0xf;
+	}
+	bool compare_and_set(uint64_t i, uint8_t expected, uint8_t value) {
+		uint8_t *b = &storage[i >> 1];
+		int shift = (i & 1) << 2;
+		uint8_t old = __atomic_load_n(b, __ATOMIC_RELAXED);
+		for (;;) {
+			if (((old >> shift) & 0xf) != expected) return false;
+			uint8_t desired = (old & ~(0xf << shift)) | (value << shift);
+			if (__atomic_compare_exchange_n(b, &old, desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				return true;
+			}
+		}
+	}
+
+private:
+	std::vector<uint8_t> storage;
+	void *mapping;
+	size_t mapping_size;
+};
+
+// -----------------------------------------------------------------------------
+
+// Map a table written by generate_tables, reporting missing or invalid files
+bool load_table(PatternDatabase &pdb, const std::string &path, uint64_t n);
@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+// Scene and rasterizer
+#include "scene.h"
+#include "notation.h"
+#include "software_renderer.h"
+// STL headers
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Renders the puzzle once per scramble read from a file or stdin, on the CPU
+// and without any GL library. Images are seen from the default view of the
+// viewer and written as binary PPM files to DIR, named after the line of the
+// scramble (DIR/NNNNNN.ppm); blank lines and # comments are skipped. The
+// totals go to stderr.
+//
+// Usage: render_scrambles [--size N] [--resolution WxH] [--supersampling S] [--threads N] [--texture FILE] DIR [file]
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+void usage() {
+	std::cerr << "Usage: render_scrambles [--size N] [--resolution WxH] [--supersampling S] [--threads N] [--texture FILE] DIR [file], "
+		<< "with N from " << MIN_PUZZLE_SIZE << " to " << MAX_PUZZLE_SIZE << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	int size = 3;
+	int width = 640, height = 480;
+	int supersampling = 3;
+	int num_threads = 0;
+	std::string texture = DATA_DIR "stickers.jpg";
+	std::string output_dir;
+	std::string input;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			size = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+				usage();
+				return 2;
+			}
+		}
+		else if (strcmp(argv[i], "--supersampling") == 0 && i + 1 < argc) {
+			supersampling = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			num_threads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+			texture = argv[++i];
+		}
+		else if (argv[i][0] != '-' && output_dir.empty()) {
+			output_dir = argv[i];
+		}
+		else if (argv[i][0] != '-' && input.empty()) {
+			input = argv[i];
+		}
+		else {
+			usage();
+			return 2;
+		}
+	}
+	if (output_dir.empty() || size < MIN_PUZZLE_SIZE || size > MAX_PUZZLE_SIZE || width <= 0 || height <= 0 || supersampling < 1) {
+		usage();
+		return 2;
+	}
+
+	std::ifstream file;
+	if (!input.empty()) {
+		file.open(input);
+		if (!file.is_open()) {
+			std::cerr << "Could not open " << input << std::endl;
+			return 2;
+		}
+	}
+	std::istream &in = input.empty() ? std::cin : file;
+
+	Image stickers;
+	if (!load_image(texture, stickers)) {
+		std::cerr << "Could not load " << texture << std::endl;
+		return 2;
+	}
+	SoftwareRenderer renderer;
+	renderer.init(stickers, num_threads);
+
+	// The default view and projection of the viewer
+	Eigen::Matrix4f view = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/4.0, Eigen::Vector3f::UnitX())).matrix() *
+		Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/4.0, Eigen::Vector3f::UnitY())).matrix();
+	Eigen::Matrix4f proj = Eigen::Matrix4f::Identity();
+	proj(0, 0) = float(height) / float(width);
+	proj(2, 2) = -1;
+
+	CubeList cubes;
+	std::vector<unsigned char> rgb;
+	int written = 0;
+	int failures = 0;
+	double seconds = 0;
+	std::string line;
+	int line_number = 0;
+	while (std::getline(in, line)) {
+		line_number++;
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#') continue;
+		std::vector<int> moves;
+		std::string token;
+		if (!parse_moves(line, moves, &token)) {
+			std::cerr << "Line " << line_number << ": invalid move '" << token << "'" << std::endl;
+			failures++;
+			continue;
+		}
+
+		Clock::time_point begin = Clock::now();
+		build_cubes(size, cubes);
+		for (int m : moves) turn_cubes(cubes, size, m);
+		update_transforms(cubes, size);
+		renderer.render(cubes, view, proj, width, height, supersampling, rgb);
+		seconds += std::chrono::duration<double>(Clock::now() - begin).count();
+
+		char name[16];
+		snprintf(name, sizeof(name), "/%06d.ppm", line_number);
+		if (!save_ppm(output_dir + name, width, height, rgb.data())) {
+			std::cerr << "Could not write " << output_dir + name << std::endl;
+			failures++;
+			continue;
+		}
+		written++;
+	}
+	renderer.free();
+
+	std::cerr << written << " images rendered";
+	if (written > 0) {
+		std::cerr << ", " << seconds * 1000.0 / written << " ms each";
+	}
+	std::cerr << ", " << failures << " failures" << std::endl;
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+////////////////////////////////////////////////////////////////////////////////
+// Eigen's benchmark timer
+#include <bench/BenchTimer.h>
+// Cube state, scene and solvers
+#include "cube_state.h"
+#include "scene.h"
+#include "two_phase.h"
+#include "optimal.h"
+// Texture loading and the CPU rasterizer
+#include "image.h"
+#include "software_renderer.h"
+#ifdef RUBIK_COUNT_ALLOCATIONS
+#include "allocation_counter.h"
+#endif
+// STL headers
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Measures the hot paths of the viewer and the solvers, without a window.
+// Every benchmark runs a few untimed warm-up batches, then times
+// 'repetitions' batches of 'iterations' calls. The per-call median, p99 and
+// best times of the batches are written to stdout as JSON.
+//
+// Built with RUBIK_COUNT_ALLOCATIONS, the heap allocations per call on the
+// calling thread are reported as well, and the run fails if a benchmark of
+// the frame path allocates. ctest runs it as frame_path_allocations.
+//
+// Usage: rubik_bench [--repetitions N] [--tables DIR]
+
+namespace {
+
+struct Result {
+	std::string name;
+	int iterations;
+	std::vector<double> samples; // seconds per call, one per batch
+	bool frame_path; // runs on every frame of the viewer, must not allocate
+	double allocations; // per call, when counted
+};
+
+// Value below which a fraction p of the sorted samples fall
+double percentile(const std::vector<double> &sorted, double p) {
+	int i = (int) std::ceil(p * sorted.size()) - 1;
+	return sorted[std::max(0, std::min(i, (int) sorted.size() - 1))];
+}
+
+Result run(const std::string &name, int iterations, int repetitions, const std::function<void()> &fn,
+	bool frame_path = false)
+{
+	const int warmup = 3;
+	Result result;
+	result.name = name;
+	result.iterations = iterations;
+	result.frame_path = frame_path;
+	result.allocations = 0;
+	result.samples.reserve(repetitions);
+	for (int r = 0; r < warmup; r++) {
+		for (int i = 0; i < iterations; i++) fn();
+	}
+#ifdef RUBIK_COUNT_ALLOCATIONS
+	size_t allocations = allocation_count();
+#endif
+	Eigen::BenchTimer timer;
+	for (int r = 0; r < repetitions; r++) {
+		timer.start();
+		for (int i = 0; i < iterations; i++) fn();
+		timer.stop();
+		clobber();
+		result.samples.push_back(timer.value(Eigen::REAL_TIMER) / iterations);
+	}
+#ifdef RUBIK_COUNT_ALLOCATIONS
+	result.allocations = double(allocation_count() - allocations) / (repetitions * iterations);
+#endif
+	std::cerr << name << " done" << std::endl;
+	return result;
+}
+
+void print_json(const std::vector<Result> &results) {
+	std::cout << "{\n\t\"benchmarks\": [";
+	for (size_t b = 0; b < results.size(); b++) {
+		std::vector<double> sorted = results[b].samples;
+		std::sort(sorted.begin(), sorted.end());
+		std::cout << (b > 0 ? "," : "") << "\n\t\t{"
+			<< "\"name\": \"" << results[b].name << "\", "
+			<< "\"iterations\": " << results[b].iterations << ", "
+			<< "\"repetitions\": " << sorted.size() << ", "
+			<< "\"median_ns\": " << percentile(sorted, 0.5) * 1e9 << ", "
+			<< "\"p99_ns\": " << percentile(sorted, 0.99) * 1e9 << ", "
+			<< "\"min_ns\": " << sorted.front() * 1e9
+#ifdef RUBIK_COUNT_ALLOCATIONS
+			<< ", \"allocations\": " << results[b].allocations
+#endif
+			<< "}";
+	}
+	std::cout << "\n\t]\n}" << std::endl;
+}
+
+// Random scrambles, the same on every run
+std::vector<CubeState> scrambles(int count, int length, unsigned seed) {
+	std::mt19937 rng(seed);
+	std::vector<CubeState> states(count);
+	for (CubeState &state : states) {
+		for (int i = 0; i < length; i++) state.move(rng() % NUM_MOVES);
+	}
+	return states;
+}
+
+// Queue random moves on a player, one turn ends per call of end_turn()
+void queue_random_moves(TurnPlayer &player, int count, std::mt19937 &rng) {
+	player.clear();
+	for (int i = 0; i < count; i++) player.moves.push_back(rng() % NUM_ALL_MOVES);
+}
+
+// Move the clock of a player halfway into the turn after the one playing, so
+// play() ends a turn (two when they commute) like a frame of the viewer does
+void end_turn(TurnPlayer &player, CubeList &cubes, int size, OrientedState &state) {
+	TurnPlayer::Clock::duration turn = std::chrono::duration_cast<TurnPlayer::Clock::duration>(
+		std::chrono::duration<float>(1.5f * player.seconds));
+	player.play(player.start + turn, cubes, size, state);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	int repetitions = 50;
+	std::string tables = DATA_DIR "tables";
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+			repetitions = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--tables") == 0 && i + 1 < argc) {
+			tables = argv[++i];
+		}
+		else {
+			std::cerr << "Usage: rubik_bench [--repetitions N] [--tables DIR]" << std::endl;
+			return 2;
+		}
+	}
+
+	// The scene of the viewer, scrambled so the transforms are not trivial
+	std::mt19937 rng(1);
+	CubeList cubes;
+	build_cubes(3, cubes);
+	OrientedState puzzle;
+	for (int i = 0; i < 25; i++) {
+		int m = rng() % NUM_ALL_MOVES;
+		turn_cubes(cubes, 3, m);
+		puzzle.move(m);
+	}
+	update_transforms(cubes, 3);
+	Eigen::Matrix4f view = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/4.0, Eigen::Vector3f::UnitX())).matrix() *
+		Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/4.0, Eigen::Vector3f::UnitY())).matrix();
+
+	std::vector<Result> results;
+	int counter = 0;
+
+	// Applying a face turn to the cubie state
+	CubeState state = puzzle.state;
+	results.push_back(run("face_turn", 100000, repetitions, [&]() {
+		state.move(counter++ % NUM_MOVES);
+		escape(&state);
+	}, true));
+
+	// End of a turn in play(), through the TurnPlayer of the viewer: apply
+	// any move to the cubes and the state, and refresh the transforms. The
+	// queue is filled beforehand, as moves are queued on input.
+	TurnPlayer player;
+	queue_random_moves(player, 2 * (repetitions + 10) * 1000, rng);
+	results.push_back(run("end_of_turn", 1000, repetitions, [&]() {
+		end_turn(player, cubes, 3, puzzle);
+	}, true));
+
+	// The same on the largest puzzle the viewer loads quickly
+	const int big_size = 21;
+	CubeList big_cubes;
+	results.push_back(run("build_cubes_21", 1, std::min(repetitions, 20), [&]() {
+		build_cubes(big_size, big_cubes);
+	}));
+	OrientedState big_puzzle;
+	queue_random_moves(player, 2 * (repetitions + 10) * 100, rng);
+	results.push_back(run("end_of_turn_21", 100, repetitions, [&]() {
+		end_turn(player, big_cubes, big_size, big_puzzle);
+	}, true));
+
+	// Picking of mouse_button_callback, across a grid of rays
+	results.push_back(run("pick_cube", 100, repetitions, [&]() {
+		int i = counter++;
+		Eigen::Vector3f origin((i % 10) * 0.1f - 0.45f, (i / 10 % 10) * 0.1f - 0.45f, 1.0f);
+		Pick pick = pick_cube(cubes, view, origin, Eigen::Vector3f(0, 0, -1));
+		escape(&pick);
+	}, true));
+
+	// Texture load at startup
+	Image pixels;
+	if (load_image(DATA_DIR "stickers.jpg", pixels)) {
+		results.push_back(run("load_image", 1, std::min(repetitions, 20), [&]() {
+			load_image(DATA_DIR "stickers.jpg", pixels);
+		}));
+	}
+	else {
+		std::cerr << "Skipping load_image: " << DATA_DIR "stickers.jpg" << " not found" << std::endl;
+	}
+
+	// A thumbnail of render_scrambles, drawn on the CPU
+	if (pixels.size() > 0) {
+		SoftwareRenderer renderer;
+		renderer.init(pixels);
+		Eigen::Matrix4f proj = Eigen::Matrix4f::Identity();
+		proj(2, 2) = -1;
+		std::vector<unsigned char> rgb;
+		results.push_back(run("software_render_256", 10, repetitions, [&]() {
+			renderer.render(cubes, view, proj, 256, 256, 3, rgb);
+			escape(rgb.data());
+		}));
+	}
+
+	// Solver runs on fixed scrambles, when the tables were generated
+	TwoPhaseSolver two_phase;
+	if (two_phase.init(tables)) {
+		std::vector<CubeState> states = scrambles(100, 30, 2);
+		std::vector<int> solution;
+		results.push_back(run("two_phase_solve", 1, repetitions, [&]() {
+			two_phase.solve(states[counter++ % states.size()], solution);
+		}));
+		two_phase.free();
+	}
+	else {
+		std::cerr << "Skipping the two-phase solver" << std::endl;
+	}
+	OptimalSolver optimal;
+	if (optimal.init(tables)) {
+		// Short scrambles keep a run within seconds
+		std::vector<CubeState> states = scrambles(20, 10, 3);
+		std::vector<int> solution;
+		results.push_back(run("optimal_solve", 1, std::min(repetitions, 20), [&]() {
+			optimal.solve(states[counter++ % states.size()], solution);
+		}));
+		optimal.free();
+	}
+	else {
+		std::cerr << "Skipping the optimal solver" << std::endl;
+	}
+
+	print_json(results);
+#ifdef RUBIK_COUNT_ALLOCATIONS
+	int failures = 0;
+	for (const Result &result : results) {
+		if (result.frame_path && result.allocations > 0) {
+			std::cerr << result.name << " allocates " << result.allocations << " times per call" << std::endl;
+			failures++;
+		}
+	}
+	return failures > 0 ? 1 : 0;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,335 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "scene.h"
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+////////////////////////////////////////////////////////////////////////////////
+
+float cube_half_size(int size) {
+	return PUZZLE_HALF_SIZE / size;
+}
+
+MoveAxis puzzle_move_axis(int m, int size) {
+	MoveAxis move = move_axis(m);
+	int layers = 0;
+	if (move.layers & 1) layers |= 1;
+	if (move.layers & 2) layers |= ((1 << (size - 1)) - 1) & ~1;
+	if (move.layers & 4) layers |= 1 << (size - 1);
+	move.layers = layers;
+	return move;
+}
+
+int cube_layer(const Cube &cube, int face, int size) {
+	int position = (cube.rotation * cube.home).dot(face_normal(face));
+	return (size - 1 - position) / 2;
+}
+
+bool cube_on_face(const Cube &cube, int face, int size) {
+	return cube_layer(cube, face, size) == 0;
+}
+
+void build_cube_mesh(Eigen::MatrixXf &V, Eigen::MatrixXf &UV, Eigen::MatrixXf &FACE, Eigen::MatrixXi &F) {
+	// Construct 6 faces for the central cube
+	Eigen::MatrixXf front(3, 6);
+	const float h = 1;
+	front << 
+		h, h, -h, h, -h, -h, 
+		h, -h, -h, h, h, -h,
+		h, h, h, h, h, h;
+
+	Eigen::MatrixXf back(3, 6);
+	for (int c = 0; c < 6; c++) {
+		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI, Eigen::Vector3f::UnitX())).matrix() * 
+								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
+		back.col(c) << v(0), v(1), v(2);
+	}
+
+	Eigen::MatrixXf right(3, 6);
+	for (int c = 0; c < 6; c++) {
+		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2, Eigen::Vector3f::UnitY())).matrix() * 
+								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
+		right.col(c) << v(0), v(1), v(2);
+	}
+
+	Eigen::MatrixXf left(3, 6);
+	for (int c = 0; c < 6; c++) {
+		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2, Eigen::Vector3f::UnitY())).matrix() * 
+								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
+		left.col(c) << v(0), v(1), v(2);
+	}
+
+	Eigen::MatrixXf up(3, 6);
+	for (int c = 0; c < 6; c++) {
+		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(-M_PI/2, Eigen::Vector3f::UnitX())).matrix() * 
+								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
+		up.col(c) << v(0), v(1), v(2);
+	}
+
+	Eigen::MatrixXf down(3, 6);
+	for (int c = 0; c < 6; c++) {
+		Eigen::Vector4f v = Eigen::Affine3f(Eigen::AngleAxis<float>(M_PI/2, Eigen::Vector3f::UnitX())).matrix() * 
+								Eigen::Vector4f(front(0, c), front(1, c), front(2, c), 1.0f);
+		down.col(c) << v(0), v(1), v(2);
+	}
+
+	// Assemble the central cube
+	V.resize(3, 36);
+	F.resize(3, 12);
+	for (int c = 0; c < 6; c++) {
+		V.col(c) = front.col(c);
+		V.col(6 + c)= back.col(c);
+		V.col(12 + c)= right.col(c);
+		V.col(18 + c)= left.col(c);
+		V.col(24 + c)= up.col(c);
+		V.col(30 + c)= down.col(c);
+	}
+
+	// Every triangle runs clockwise seen from outside the cube, for face
+	// culling: the second triangle of each face is listed backwards
+	for (int c = 0; c < 12; c++) {
+		F(0, c) = c * 3;
+		F(1, c) = c * 3 + (c % 2 == 0 ? 1 : 2);
+		F(2, c) = c * 3 + (c % 2 == 0 ? 2 : 1);
+	}
+
+	// Sticker tile coordinates, the same for the 6 vertices of every face
+	UV.resize(2, 36);
+	FACE.resize(1, 36);
+	for (int f = 0; f < 6; f++) {
+		UV.col(f*6+0) << 1.0, 1.0;
+		UV.col(f*6+1) << 1.0, 0.0;
+		UV.col(f*6+2) << 0.0, 0.0;
+		UV.col(f*6+3) << 1.0, 1.0;
+		UV.col(f*6+4) << 0.0, 1.0;
+		UV.col(f*6+5) << 0.0, 0.0;
+		for (int v = 0; v < 6; v++) {
+			FACE(0, f*6+v) = f;
+		}
+	}
+}
+
+void build_cubes(int size, CubeList &cubes) {
+	cubes.clear();
+	cubes.reserve(size * size * size - (size - 2) * (size - 2) * (size - 2));
+	for (int x = 0; x < size; x++) {
+		for (int y = 0; y < size; y++) {
+			for (int z = 0; z < size; z++) {
+				// The inner cubes are never seen
+				bool inner = x > 0 && x < size - 1 && y > 0 && y < size - 1 && z > 0 && z < size - 1;
+				if (inner) continue;
+
+				Cube cube;
+				cube.home << 2 * x - (size - 1), 2 * y - (size - 1), 2 * z - (size - 1);
+				cube.rotation.setIdentity();
+
+				/*** Initialize the stickers ***/
+				// Tile f of the first texture row holds the sticker of face f,
+				// the faces inside the puzzle are black
+				for (int f = 0; f < 6; f++) {
+					cube.stickers[f] = cube_on_face(cube, f, size) ? f : -1;
+				}
+
+				// Moves map the planes between layers onto planes of the same
+				// kind, so the faces that can be seen only depend on the home
+				cube.exposed = 0;
+				for (int f = 0; f < 6; f++) {
+					int plane = cube.home.dot(face_normal(f)) + 1;
+					if (cube.stickers[f] >= 0 || std::abs(plane) == size - 2) {
+						cube.exposed |= 1 << f;
+					}
+				}
+
+				// The front center shows the logo from the second texture row
+				if (cube.home == Eigen::Vector3i(0, 0, size - 1)) {
+					cube.stickers[FR] = 6 + FR;
+				}
+
+				// Add the cube to the array
+				cubes.push_back(cube);
+			}
+		}
+	}
+	update_transforms(cubes, size);
+}
+
+void turn_cubes(CubeList &cubes, int size, int m) {
+	MoveAxis move = puzzle_move_axis(m, size);
+	Eigen::Matrix3i R = Eigen::Matrix3i::Identity();
+	for (int q = 0; q <= m % 3; q++) {
+		R = face_rotation(move.face) * R;
+	}
+	for (Cube &cube : cubes) {
+		if (move.layers & (1 << cube_layer(cube, move.face, size))) {
+			cube.rotation = R * cube.rotation;
+		}
+	}
+}
+
+void update_transforms(CubeList &cubes, int size) {
+	float h = cube_half_size(size);
+	for (Cube &cube : cubes) {
+		cube.T.setIdentity();
+		cube.T.block<3, 3>(0, 0) = h * cube.rotation.cast<float>();
+	}
+}
+
+TurnAnimation turn_animation(int m, int size) {
+	// A clockwise quarter turn rotates by -90 degrees around the outward
+	// normal, a counter clockwise one by 90 degrees
+	MoveAxis move = puzzle_move_axis(m, size);
+	int turns = m % 3 + 1;
+	TurnAnimation turn;
+	turn.axis = face_normal(move.face).cast<float>();
+	turn.angle = turns == 3 ? M_PI/2 : -turns * M_PI/2;
+
+	// Layers are centered 2 * h apart along the normal, the one of the face
+	// first
+	const float h = cube_half_size(size);
+	turn.layer_max = -std::numeric_limits<float>::max();
+	turn.layer_min = std::numeric_limits<float>::max();
+	for (int l = 0; l < size; l++) {
+		if (!(move.layers & (1 << l))) continue;
+		float center = (size - 1 - 2 * l) * h;
+		turn.layer_min = std::min(turn.layer_min, center - h);
+		turn.layer_max = std::max(turn.layer_max, center + h);
+	}
+	return turn;
+}
+
+bool turns_commute(int a, int b, int size) {
+	MoveAxis u = puzzle_move_axis(a, size);
+	MoveAxis v = puzzle_move_axis(b, size);
+	if (u.face / 2 != v.face / 2) return false;
+	// Layers of b counted from the face of a
+	int layers = v.layers;
+	if (u.face != v.face) {
+		layers = 0;
+		for (int l = 0; l < size; l++) {
+			if (v.layers & (1 << l)) layers |= 1 << (size - 1 - l);
+		}
+	}
+	return (u.layers & layers) == 0;
+}
+
+TurnPlayer::TurnPlayer()
+	: playing(-1), num_turns(0), progress(0), duration(TURN_DURATION), seconds(TURN_DURATION)
+{ }
+
+void TurnPlayer::clear() {
+	moves.clear();
+	playing = -1;
+	num_turns = 0;
+	progress = 0;
+}
+
+bool TurnPlayer::play(Clock::time_point now, CubeList &cubes, int size, OrientedState &state) {
+	if (playing == -1) {
+		if (moves.empty()) return false;
+		seconds = duration;
+		start = now;
+		start_turn(size);
+	}
+
+	// Turns shorter than a frame are finished without being drawn
+	float time = std::chrono::duration_cast<std::chrono::duration<float> >(now - start).count();
+	bool finished = false;
+	while (time >= seconds) {
+		finish_turn(cubes, size, state);
+		finished = true;
+		time -= seconds;
+		start += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(seconds));
+		if (moves.empty()) {
+			playing = -1;
+			break;
+		}
+		start_turn(size);
+	}
+	progress = playing == -1 ? 0 : time / seconds;
+
+	// Take the final transforms from the rotations of the cubes
+	if (finished) {
+		update_transforms(cubes, size);
+	}
+	return finished;
+}
+
+// The deeper the queue, the shorter the turn, and turns stay short until the
+// queue is empty so that flushing it takes QUEUE_DURATION at most
+void TurnPlayer::start_turn(int size) {
+	playing = moves.front();
+	turns[0] = turn_animation(playing, size);
+	num_turns = 1;
+	if (moves.size() > 1 && turns_commute(playing, moves[1], size)) {
+		turns[1] = turn_animation(moves[1], size);
+		num_turns = 2;
+	}
+	seconds = std::min(seconds, QUEUE_DURATION / moves.size());
+}
+
+void TurnPlayer::finish_turn(CubeList &cubes, int size, OrientedState &state) {
+	for (int i = 0; i < num_turns; i++) {
+		int m = moves.front();
+		turn_cubes(cubes, size, m);
+		state.move(m);
+		moves.pop_front();
+	}
+}
+
+int puzzle_face(const Cube &cube, int local_face) {
+	// Outward normal of the face, turned into the puzzle frame
+	Eigen::Vector3f normal = cube.T.block<3, 3>(0, 0) * face_normal(local_face).cast<float>();
+	int face = 0;
+	for (int f = 1; f < 6; f++) {
+		if (normal.dot(face_normal(f).cast<float>()) > normal.dot(face_normal(face).cast<float>())) face = f;
+	}
+	return face;
+}
+
+Pick pick_cube(const CubeList &cubes, const Eigen::Matrix4f &view,
+	const Eigen::Vector3f &ray_origin, const Eigen::Vector3f &ray_direction)
+{
+	Pick pick;
+	pick.cube = -1;
+	pick.face = -1;
+	pick.t = std::numeric_limits<float>::max();
+	// The transforms scale the unit cube to the size of the cubes
+	const float h = 1;
+	for (int m = 0; m < (int) cubes.size(); m++) {
+		Eigen::Affine3f model(cubes[m].T);
+		Eigen::Affine3f to_local = (Eigen::Affine3f(view) * model * Eigen::Translation3f(cubes[m].home.cast<float>())).inverse();
+		Eigen::Vector3f o = to_local * ray_origin;
+		Eigen::Vector3f d = to_local.linear() * ray_direction;
+
+		// Slab test, keeping the axis and side the ray enters through
+		float t_near = 0;
+		float t_far = std::numeric_limits<float>::max();
+		int axis = -1;
+		bool hit = true;
+		for (int i = 0; i < 3 && hit; i++) {
+			if (d(i) == 0) {
+				hit = std::abs(o(i)) <= h;
+				continue;
+			}
+			float t1 = (-h - o(i)) / d(i);
+			float t2 = (h - o(i)) / d(i);
+			if (t1 > t2) std::swap(t1, t2);
+			if (t1 > t_near) {
+				t_near = t1;
+				axis = i;
+			}
+			t_far = std::min(t_far, t2);
+			hit = t_near <= t_far;
+		}
+		if (!hit || axis < 0 || t_near >= pick.t) continue;
+
+		// Face of the cube the ray enters through
+		static const int entered[3][2] = {{RI, LE}, {UP, DO}, {FR, BA}};
+		int face = puzzle_face(cubes[m], entered[axis][d(axis) > 0]);
+		pick.cube = m;
+		pick.face = face;
+		pick.t = t_near;
+	}
+	return pick;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "cube_state.h"
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <chrono>
+#include <deque>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Default duration of a quarter turn in seconds
+#define TURN_DURATION 0.96f
+
+// Longest time a queue of turns takes to play, turns get shorter when many
+// are queued
+#define QUEUE_DURATION 8.0f
+
+// Layers along each axis of the puzzle: N x N x N cubes. Layer sets are bit
+// masks of an int.
+#define MIN_PUZZLE_SIZE 2
+#define MAX_PUZZLE_SIZE 30
+
+// Half the edge length of the whole puzzle, whatever its size
+#define PUZZLE_HALF_SIZE 0.45f
+
+// Only the N^3 - (N-2)^3 cubes on the surface of the puzzle exist. Positions
+// are counted in half cube edges from the center of the puzzle: coordinates
+// run from -(N-1) to N-1 by steps of 2.
+
+// Cube object, CPU data only: all the cubes share the GPU mesh
+struct Cube {
+	// Position of the cube in the solved puzzle
+	Eigen::Vector3i home;
+
+	// Texture tile shown on each face (-1 for black plastic)
+	int stickers[6];
+
+	// Faces that can ever be seen, bit f for face f: the stickers, and the
+	// black faces on the planes a turn opens (between an outer layer and the
+	// next one). The others stay pressed against a neighbour whatever the
+	// moves, so they are never drawn.
+	int exposed;
+
+	// Rotation of the cube around the center of the puzzle, it currently
+	// sits at rotation * home
+	Eigen::Matrix3i rotation;
+
+	// The transform matrix: the rotation, scaled to the size of a cube
+	Eigen::Matrix4f T;
+};
+
+// Cubes hold fixed-size vectorizable matrices, which need an aligned allocator
+typedef std::vector<Cube, Eigen::aligned_allocator<Cube> > CubeList;
+
+// The cube and face under a ray
+struct Pick {
+	int cube; // -1 if nothing was hit
+	int face; // side of the world the hit face points to (FR..DO)
+	float t;  // ray parameter of the hit
+};
+
+// A turn as played by the vertex shader: the cubes whose center lies between
+// layer_min and layer_max along the axis rotate by up to angle around it
+struct TurnAnimation {
+	Eigen::Vector3f axis;
+	float angle;
+	float layer_min;
+	float layer_max;
+};
+
+// The queue of moves played by the viewer, without any GL: the turns at its
+// front are animated over time, then applied to the cubes and the cube state
+struct TurnPlayer {
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Queued moves (see move_axis), the front ones are being played
+	std::deque<int> moves;
+
+	// The move being played, -1 if none
+	int playing;
+
+	// The turns being played: the front of the queue, and the next move when
+	// it commutes
+	TurnAnimation turns[2];
+	int num_turns;
+
+	// Progress of the turns being played, from 0 to 1
+	float progress;
+
+	// Duration of a quarter turn in seconds
+	float duration;
+
+	// Duration of the turn being played, shorter than duration when the
+	// queue is deep
+	float seconds;
+
+	// Time the turn being played started at
+	Clock::time_point start;
+
+	TurnPlayer();
+
+	// Drop the queue and the turn being played
+	void clear();
+
+	// Whether a turn is playing or waiting in the queue
+	bool animating() const { return playing != -1 || !moves.empty(); }
+
+	// Play the queue up to a time point. Returns true when turns ended: they
+	// are applied to the cubes and the state, and the transforms are updated.
+	bool play(Clock::time_point now, CubeList &cubes, int size, OrientedState &state);
+
+	// Start the turn at the front of the queue, and the next one when it commutes
+	void start_turn(int size);
+
+	// Apply the turns being played and pop them from the queue
+	void finish_turn(CubeList &cubes, int size, OrientedState &state);
+};
+
+// -----------------------------------------------------------------------------
+
+// Half the edge length of a cube in a puzzle of the given size
+float cube_half_size(int size);
+
+// Layers turned by a move in a puzzle of the given size, counted from the
+// face of the move. The layers of move_axis() become the outer layer of the
+// face, all the inner layers and the outer layer of the opposite face.
+MoveAxis puzzle_move_axis(int m, int size);
+
+// Layer of a cube counted from a face of the world, 0 is the face itself
+int cube_layer(const Cube &cube, int face, int size);
+
+// Check whether a cube currently sits on a face of the world
+bool cube_on_face(const Cube &cube, int face, int size);
+
+// Build the central cube: 6 faces of 2 triangles, the position inside the
+// sticker tile and the face of every vertex. The cube spans [-1, 1], the
+// transforms scale it.
+void build_cube_mesh(Eigen::MatrixXf &V, Eigen::MatrixXf &UV, Eigen::MatrixXf &FACE, Eigen::MatrixXi &F);
+
+// Build the surface cubes of a solved puzzle
+void build_cubes(int size, CubeList &cubes);
+
+// Apply a move to the rotations of the cubes
+void turn_cubes(CubeList &cubes, int size, int m);
+
+// Take the transform of every cube from its rotation
+void update_transforms(CubeList &cubes, int size);
+
+// Animation of a move (see puzzle_move_axis), half turns are a single motion
+TurnAnimation turn_animation(int m, int size);
+
+// Whether two moves turn disjoint layers around the same axis (R and L', R
+// and M), so they can be played at the same time
+bool turns_commute(int a, int b, int size);
+
+// Side of the world (FR..DO) a face of the central cube currently points to,
+// once the cube is turned by its transform
+int puzzle_face(const Cube &cube, int local_face);
+
+// Closest cube hit by a ray given in view space. The ray is moved into the
+// frame of every cube and tested against its box.
+Pick pick_cube(const CubeList &cubes, const Eigen::Matrix4f &view,
+	const Eigen::Vector3f &ray_origin, const Eigen::Vector3f &ray_direction);
@@ -0,0 +1,359 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "software_renderer.h"
+#include "trace.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// 8 samples of a row, as many as an AVX register holds
+typedef Eigen::Array<float, 8, 1> Lanes;
+
+// Colors the stickers of each face are multiplied with, as in the viewer
+const float face_colors[6][3] = {
+	{243 / 255.0f, 243 / 255.0f, 243 / 255.0f},
+	{240 / 255.0f, 179 / 255.0f, 42 / 255.0f},
+	{88 / 255.0f, 128 / 255.0f, 243 / 255.0f},
+	{50 / 255.0f, 156 / 255.0f, 88 / 255.0f},
+	{226 / 255.0f, 112 / 255.0f, 30 / 255.0f},
+	{221 / 255.0f, 68 / 255.0f, 51 / 255.0f},
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SoftwareRenderer::SoftwareRenderer()
+	: pool(NULL), width(0), height(0), supersampling(1), sample_width(0), sample_height(0), tiles_x(0), tiles_y(0)
+{ }
+
+SoftwareRenderer::~SoftwareRenderer() {
+	free();
+}
+
+void SoftwareRenderer::init(const Image &stickers, int threads) {
+	build_cube_mesh(V, UV, FACE, F);
+	int found[6] = {0};
+	for (int t = 0; t < F.cols(); t++) {
+		int face = (int) FACE(0, F(0, t));
+		face_triangles[face][found[face]++] = t;
+	}
+
+	// Mipmaps down to a single texel, each texel averaging 2 x 2 of the level
+	// above. Texels are 4 floats, blended as one SSE packet.
+	levels.resize(1);
+	levels[0].width = std::max<int>(1, stickers.rows());
+	levels[0].height = std::max<int>(1, stickers.cols());
+	levels[0].texels.assign(levels[0].width * levels[0].height, Eigen::Array4f::Ones());
+	for (int y = 0; y < stickers.cols(); y++) {
+		for (int x = 0; x < stickers.rows(); x++) {
+			levels[0].texels[y * levels[0].width + x] = stickers(x, y).cast<float>().array() / 255.0f;
+		}
+	}
+	while (levels.back().width > 1 || levels.back().height > 1) {
+		const MipLevel &above = levels.back();
+		MipLevel level;
+		level.width = std::max(1, above.width / 2);
+		level.height = std::max(1, above.height / 2);
+		level.texels.resize(level.width * level.height);
+		for (int y = 0; y < level.height; y++) {
+			for (int x = 0; x < level.width; x++) {
+				int x0 = std::min(2 * x, above.width - 1), x1 = std::min(2 * x + 1, above.width - 1);
+				int y0 = std::min(2 * y, above.height - 1), y1 = std::min(2 * y + 1, above.height - 1);
+				level.texels[y * level.width + x] = 0.25f * (above.texels[y0 * above.width + x0]
+					+ above.texels[y0 * above.width + x1] + above.texels[y1 * above.width + x0]
+					+ above.texels[y1 * above.width + x1]);
+			}
+		}
+		levels.push_back(level);
+	}
+
+	if (threads <= 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	delete pool;
+	pool = new Eigen::NonBlockingThreadPool(threads);
+	thread_samples.resize(threads);
+}
+
+void SoftwareRenderer::free() {
+	delete pool;
+	pool = NULL;
+}
+
+void SoftwareRenderer::render(const CubeList &cubes, const Eigen::Matrix4f &view, const Eigen::Matrix4f &proj,
+	int width, int height, int supersampling, std::vector<unsigned char> &rgb)
+{
+	TRACE_SCOPE("software_render");
+	this->width = width;
+	this->height = height;
+	this->supersampling = std::max(1, supersampling);
+	sample_width = width * this->supersampling;
+	sample_height = height * this->supersampling;
+	tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	bins.resize(tiles_x * tiles_y);
+	for (std::vector<int> &bin : bins) bin.clear();
+	quads.clear();
+	// Samples of a tile, kept in the cache of the thread drawing it
+	int tile_samples = RASTER_TILE_SIZE * RASTER_TILE_SIZE * this->supersampling * this->supersampling;
+	for (TileSamples &samples : thread_samples) {
+		samples.ids.resize(tile_samples);
+		samples.depths.resize(tile_samples);
+	}
+	rgb.resize(3 * width * height);
+
+	// From normalized device coordinates to samples, y pointing down the image
+	Eigen::Matrix4f viewport = Eigen::Matrix4f::Identity();
+	viewport(0, 0) = 0.5f * sample_width;
+	viewport(0, 3) = 0.5f * sample_width;
+	viewport(1, 1) = -0.5f * sample_height;
+	viewport(1, 3) = 0.5f * sample_height;
+	Eigen::Matrix4f view_proj = viewport * proj * view;
+
+	{
+		TRACE_SCOPE("software_setup");
+		for (const Cube &cube : cubes) {
+			Eigen::Matrix4f model = cube.T * Eigen::Affine3f(Eigen::Translation3f(cube.home.cast<float>())).matrix();
+			Eigen::Matrix4f transform = view_proj * model;
+			for (int f = 0; f < 6; f++) {
+				if (cube.stickers[f] >= 0) setup_face(transform, f, cube.stickers[f]);
+			}
+		}
+	}
+
+	// Tiles own their samples and pixels, so they are drawn independently
+	std::mutex mutex;
+	std::condition_variable finished;
+	int pending = tiles_x * tiles_y;
+	for (int tile = 0; tile < tiles_x * tiles_y; tile++) {
+		pool->Schedule([&, tile]() {
+			draw_tile(tile, rgb);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0) {
+				finished.notify_one();
+			}
+		});
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [&]() { return pending == 0; });
+}
+
+void SoftwareRenderer::setup_face(const Eigen::Matrix4f &transform, int face, int tile) {
+	// The corners of the first triangle, and the one of the second triangle
+	// across their shared edge
+	int first = face_triangles[face][0], second = face_triangles[face][1];
+	Eigen::Vector3f p[3];
+	Eigen::Array3f u, v;
+	for (int i = 0; i < 3; i++) {
+		Eigen::Vector4f q = transform * V.col(F(i, first)).homogeneous();
+		p[i] = q.head<3>() / q(3);
+		// Position in the atlas, a grid of 6 x 2 tiles
+		u(i) = (tile % 6 + UV(0, F(i, first))) / 6.0f;
+		v(i) = 0.5f * (1.0f - tile / 6 + UV(1, F(i, first)));
+	}
+	// The corner of the second triangle missing from the first one
+	int shared[3] = {0};
+	Eigen::Vector3f opposite = Eigen::Vector3f::Constant(-1);
+	int opposites = 0;
+	for (int j = 0; j < 3; j++) {
+		Eigen::Vector3f corner = V.col(F(j, second));
+		bool found = false;
+		for (int i = 0; i < 3; i++) {
+			if (V.col(F(i, first)) == corner) shared[i] = found = true;
+		}
+		if (!found) {
+			Eigen::Vector4f q = transform * corner.homogeneous();
+			opposite = q.head<3>() / q(3);
+			opposites++;
+		}
+	}
+	assert(opposites == 1);
+
+	// Edge functions of the first triangle, each one zero on the edge
+	// opposite to a vertex. The mesh is wound clockwise seen from outside,
+	// counter clockwise once y points down, so back faces have a negative
+	// area.
+	Eigen::Array3f a, b, c;
+	for (int i = 0; i < 3; i++) {
+		const Eigen::Vector3f &from = p[(i + 1) % 3], &to = p[(i + 2) % 3];
+		a(i) = from.y() - to.y();
+		b(i) = to.x() - from.x();
+		c(i) = from.x() * to.y() - to.x() * from.y();
+	}
+	float area = a(0) * p[0].x() + b(0) * p[0].y() + c(0);
+	if (area <= 0) return;
+
+	// Attributes are linear in screen space (the projection is orthographic):
+	// each one is the sum of its vertex values weighted by the normalized
+	// edge functions
+	Quad quad;
+	Eigen::Array3f z(p[0].z(), p[1].z(), p[2].z());
+	quad.depth << (a * z).sum(), (b * z).sum(), (c * z).sum();
+	quad.u << (a * u).sum(), (b * u).sum(), (c * u).sum();
+	quad.v << (a * v).sum(), (b * v).sum(), (c * v).sum();
+	quad.depth /= area;
+	quad.u /= area;
+	quad.v /= area;
+
+	// The outline, with the opposite corner inserted into the shared edge
+	Eigen::Vector3f corners[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++) {
+		corners[count++] = p[i];
+		if (shared[i] && shared[(i + 1) % 3]) corners[count++] = opposite;
+	}
+	for (int i = 0; i < 4; i++) {
+		const Eigen::Vector3f &from = corners[i], &to = corners[(i + 1) % 4];
+		quad.a(i) = from.y() - to.y();
+		quad.b(i) = to.x() - from.x();
+		quad.c(i) = from.x() * to.y() - to.x() * from.y();
+	}
+
+	// Samples whose center lies within the bounds
+	float min_x = corners[0].x(), max_x = corners[0].x(), min_y = corners[0].y(), max_y = corners[0].y();
+	for (int i = 1; i < 4; i++) {
+		min_x = std::min(min_x, corners[i].x());
+		max_x = std::max(max_x, corners[i].x());
+		min_y = std::min(min_y, corners[i].y());
+		max_y = std::max(max_y, corners[i].y());
+	}
+	quad.x0 = std::max(0, (int) std::ceil(min_x - 0.5f));
+	quad.x1 = std::min(sample_width, (int) std::floor(max_x - 0.5f) + 1);
+	quad.y0 = std::max(0, (int) std::ceil(min_y - 0.5f));
+	quad.y1 = std::min(sample_height, (int) std::floor(max_y - 0.5f) + 1);
+	if (quad.x0 >= quad.x1 || quad.y0 >= quad.y1) return;
+
+	// The texels covered by a pixel give the mipmap level
+	const MipLevel &base = levels[0];
+	float along_x = supersampling * std::hypot(quad.u(0) * base.width, quad.v(0) * base.height);
+	float along_y = supersampling * std::hypot(quad.u(1) * base.width, quad.v(1) * base.height);
+	float lod = std::log2(std::max(std::max(along_x, along_y), 1e-6f));
+	quad.level = std::max(0, std::min((int) std::lround(lod), (int) levels.size() - 1));
+	quad.color << face_colors[face][0], face_colors[face][1], face_colors[face][2];
+
+	// Bin the quad to the tiles of its bounds that it may cover: a tile is
+	// skipped when its corner furthest inside an edge is outside
+	int index = (int) quads.size();
+	quads.push_back(quad);
+	int size = RASTER_TILE_SIZE * supersampling;
+	for (int ty = quad.y0 / size; ty <= (quad.y1 - 1) / size; ty++) {
+		for (int tx = quad.x0 / size; tx <= (quad.x1 - 1) / size; tx++) {
+			bool outside = false;
+			for (int i = 0; i < 4 && !outside; i++) {
+				float x = (quad.a(i) > 0 ? (tx + 1) * size : tx * size);
+				float y = (quad.b(i) > 0 ? (ty + 1) * size : ty * size);
+				outside = quad.a(i) * x + quad.b(i) * y + quad.c(i) < 0;
+			}
+			if (!outside) bins[ty * tiles_x + tx].push_back(index);
+		}
+	}
+}
+
+void SoftwareRenderer::draw_tile(int tile, std::vector<unsigned char> &rgb) {
+	int size = RASTER_TILE_SIZE * supersampling;
+	int tx = tile % tiles_x, ty = tile / tiles_x;
+	int sx0 = tx * size, sy0 = ty * size;
+
+	// Cleared to the far plane, with no face
+	TileSamples &samples = thread_samples[pool->CurrentThreadId()];
+	std::fill(samples.ids.begin(), samples.ids.end(), -1);
+	std::fill(samples.depths.begin(), samples.depths.end(), 1.0f);
+
+	// Visibility only: the depth and the face of every sample, 8 samples of
+	// a row at a time from the left of the tile so that they never straddle
+	// 2 tiles. Samples outside of the bounds of a face are outside of its
+	// edges too.
+	const Lanes offsets = Lanes::LinSpaced(8, 0.5f, 7.5f);
+	for (int q : bins[tile]) {
+		const Quad &quad = quads[q];
+		int x0 = sx0 + (std::max(quad.x0, sx0) - sx0) / 8 * 8, x1 = std::min(quad.x1, sx0 + size);
+		int y0 = std::max(quad.y0, sy0), y1 = std::min(quad.y1, sy0 + size);
+		for (int y = y0; y < y1; y++) {
+			float py = y + 0.5f;
+			Eigen::Array4f row = quad.b * py + quad.c;
+			float row_depth = quad.depth(1) * py + quad.depth(2);
+			for (int x = x0; x < x1; x += 8) {
+				// A sample is inside when all 4 edge functions are positive
+				Lanes px = offsets + float(x);
+				Lanes inside = (quad.a(0) * px + row(0)).min(quad.a(1) * px + row(1))
+					.min(quad.a(2) * px + row(2)).min(quad.a(3) * px + row(3));
+				if (inside.maxCoeff() < 0) continue;
+				Lanes z = quad.depth(0) * px + row_depth;
+				float *depth = &samples.depths[(y - sy0) * size + x - sx0];
+				int *id = &samples.ids[(y - sy0) * size + x - sx0];
+				for (int i = 0; i < 8; i++) {
+					bool closer = inside(i) >= 0 && z(i) < depth[i];
+					depth[i] = closer ? z(i) : depth[i];
+					id[i] = closer ? q : id[i];
+				}
+			}
+		}
+	}
+
+	// Like multisampling, the texture is sampled once per pixel and visible
+	// face, at the center of the pixel, and the samples are averaged. Runs
+	// of samples seeing the same face are shaded once.
+	const int ss = supersampling;
+	const float weight = 255.0f / (ss * ss);
+	const int *tile_ids = samples.ids.data();
+	const Quad *tile_quads = quads.data();
+	int px0 = tx * RASTER_TILE_SIZE, px1 = std::min(width, px0 + RASTER_TILE_SIZE);
+	int py0 = ty * RASTER_TILE_SIZE, py1 = std::min(height, py0 + RASTER_TILE_SIZE);
+	for (int y = py0; y < py1; y++) {
+		float center_y = (y + 0.5f) * ss;
+		unsigned char *out = &rgb[3 * (y * width + px0)];
+		for (int x = px0; x < px1; x++) {
+			float center_x = (x + 0.5f) * ss;
+			auto shade = [&](int q) -> Eigen::Array3f {
+				if (q < 0) return Eigen::Array3f::Ones();
+				const Quad &quad = tile_quads[q];
+				float u = quad.u(0) * center_x + quad.u(1) * center_y + quad.u(2);
+				float v = quad.v(0) * center_x + quad.v(1) * center_y + quad.v(2);
+				return sample(levels[quad.level], u, v) * quad.color;
+			};
+
+			const int *id = tile_ids + (y - py0) * ss * size + (x - px0) * ss;
+			Eigen::Array3f sum = Eigen::Array3f::Zero();
+			int last = id[0];
+			int run = 0;
+			for (int j = 0; j < ss; j++, id += size) {
+				for (int i = 0; i < ss; i++) {
+					if (id[i] != last) {
+						sum += float(run) * shade(last);
+						last = id[i];
+						run = 0;
+					}
+					run++;
+				}
+			}
+			sum += float(run) * shade(last);
+			sum = (sum * weight).min(255.0f) + 0.5f;
+			*out++ = (unsigned char) sum(0);
+			*out++ = (unsigned char) sum(1);
+			*out++ = (unsigned char) sum(2);
+		}
+	}
+}
+
+Eigen::Array3f SoftwareRenderer::sample(const MipLevel &level, float u, float v) const {
+	// Texels around the sample and the weights of the right and top ones,
+	// floored with a cast since coordinates are never far below 0
+	float x = u * level.width + 1023.5f;
+	float y = v * level.height + 1023.5f;
+	int ix = (int) x, iy = (int) y;
+	float fx = x - ix, fy = y - iy;
+	ix -= 1024;
+	iy -= 1024;
+	int x0 = std::max(0, std::min(ix, level.width - 1)), x1 = std::max(0, std::min(ix + 1, level.width - 1));
+	int y0 = std::max(0, std::min(iy, level.height - 1)), y1 = std::max(0, std::min(iy + 1, level.height - 1));
+	const Eigen::Array4f *t = level.texels.data();
+	Eigen::Array4f color = (1 - fy) * ((1 - fx) * t[y0 * level.width + x0] + fx * t[y0 * level.width + x1])
+		+ fy * ((1 - fx) * t[y1 * level.width + x0] + fx * t[y1 * level.width + x1]);
+	return color.head<3>();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "scene.h"
+#include "image.h"
+#include <Eigen/Dense>
+#include <unsupported/Eigen/CXX11/ThreadPool>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// Draws the puzzle into an RGB image on the CPU, without any GL library.
+// The faces with a sticker are the only ones on the outside of a puzzle at
+// rest, so they are the only ones drawn, culled and shaded like the viewer
+// does. The 2 triangles of a face share their planes under the orthographic
+// projection, so a face is rasterized as one quad with 4 edge functions.
+// Faces are binned into square tiles of the image, the tiles are drawn on a
+// thread pool, and edge functions are evaluated over 8 samples of a row at a
+// time. Samples only keep the face they see, the texture is sampled once per
+// pixel afterwards.
+
+// Edge length of a tile in pixels of the image
+#define RASTER_TILE_SIZE 32
+
+class SoftwareRenderer {
+public:
+	SoftwareRenderer();
+	~SoftwareRenderer();
+
+	// Take the sticker atlas (see load_image) and start 'threads' threads, 0
+	// for one per core
+	void init(const Image &stickers, int threads = 0);
+
+	// Draw the cubes through the view and projection matrices of the viewer
+	// into 'rgb', top row first. Every pixel averages 'supersampling' x
+	// 'supersampling' samples.
+	void render(const CubeList &cubes, const Eigen::Matrix4f &view, const Eigen::Matrix4f &proj,
+		int width, int height, int supersampling, std::vector<unsigned char> &rgb);
+
+	// Stop the threads
+	void free();
+
+private:
+	// A level of the mipmaps of the atlas, in RGBA from 0 to 1, row 0 at
+	// v = 0
+	struct MipLevel {
+		int width;
+		int height;
+		std::vector<Eigen::Array4f, Eigen::aligned_allocator<Eigen::Array4f> > texels;
+	};
+
+	// A face in samples: edge functions a*x + b*y + c, positive inside,
+	// and the planes of depth and texture coordinates
+	struct Quad {
+		Eigen::Array4f a, b, c;
+		Eigen::Array3f depth, u, v; // coefficients of x, y and 1
+		int x0, y0, x1, y1; // bounding box, the max excluded
+		int level;
+		Eigen::Array3f color;
+	};
+	typedef std::vector<Quad, Eigen::aligned_allocator<Quad> > QuadList;
+
+	// The samples of a tile being drawn, row by row
+	struct TileSamples {
+		std::vector<int> ids; // quad seen by each sample, -1 for none
+		std::vector<float> depths;
+	};
+
+	// Add a face of a cube seen through 'transform', unless it is turned away
+	void setup_face(const Eigen::Matrix4f &transform, int face, int tile);
+
+	// Find the face seen by each sample of a tile, then shade its pixels
+	void draw_tile(int tile, std::vector<unsigned char> &rgb);
+
+	// Bilinear fetch from a mipmap level, clamped to its edges
+	Eigen::Array3f sample(const MipLevel &level, float u, float v) const;
+
+	std::vector<MipLevel> levels;
+	// The mesh of the viewer, and its 2 triangles (columns of F) on each face
+	Eigen::MatrixXf V, UV, FACE;
+	Eigen::MatrixXi F;
+	int face_triangles[6][2];
+	Eigen::NonBlockingThreadPool *pool;
+
+	// State of the image being drawn
+	int width, height, supersampling;
+	int sample_width, sample_height; // in samples
+	int tiles_x, tiles_y;
+	QuadList quads;
+	std::vector<std::vector<int> > bins; // quads touching each tile
+	std::vector<TileSamples> thread_samples; // one tile per thread
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+////////////////////////////////////////////////////////////////////////////////
+
+// Shared between a running solve and other threads: the solver reports the
+// depth bound it is searching and stops early once 'cancel' is set.
+struct SolveControl {
+	std::atomic<bool> cancel;
+	std::atomic<int> depth;
+
+	SolveControl() : cancel(false), depth(0) { }
+
+	bool cancelled() const { return cancel.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,29 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "solve_job.h"
+#include "trace.h"
+#include <cassert>
+////////////////////////////////////////////////////////////////////////////////
+
+void SolveJob::start(const CubeState &s, const Solve &solve) {
+	assert(!running);
+	state = s;
+	solution.clear();
+	solved = false;
+	control.cancel = false;
+	control.depth = 0;
+	done = false;
+	running = true;
+	thread = std::thread([this, solve]() {
+		trace_thread_name("solve");
+		TRACE_SCOPE("solve");
+		solved = solve(state, solution, control);
+		done.store(true, std::memory_order_release);
+	});
+}
+
+void SolveJob::join() {
+	if (running) {
+		thread.join();
+		running = false;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "cube_state.h"
+#include "solve_control.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+// A solve running on a background thread. The result is published with a
+// single release store, so the render loop only polls finished() and never
+// waits on a lock.
+class SolveJob {
+public:
+	typedef std::function<bool(const CubeState &, std::vector<int> &, SolveControl &)> Solve;
+
+	CubeState state;           // the state being solved
+	std::vector<int> solution; // only valid once finished() returns true
+	bool solved;               // only valid once finished() returns true
+	SolveControl control;      // progress and cancellation
+
+	SolveJob() : solved(false), running(false), done(false) { }
+
+	// Run 'solve' on a new thread, the previous job must have been joined
+	void start(const CubeState &s, const Solve &solve);
+
+	// True from start() until join()
+	bool active() const { return running; }
+
+	// True once the solution has been published
+	bool finished() const { return done.load(std::memory_order_acquire); }
+
+	// Ask the solver to stop, finished() becomes true shortly after
+	void cancel() { control.cancel = true; }
+
+	// Wait for the thread; call cancel() first to stop early
+	void join();
+
+private:
+	std::thread thread;
+	bool running;
+	std::atomic<bool> done;
+};
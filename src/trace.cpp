@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+
+std::atomic<bool> tracing(false);
+
+namespace {
+
+struct Span {
+	const char *name;
+	int64_t start;
+	int64_t end;
+};
+
+// Spans of one thread. Its mutex is only contended while the trace is
+// written or restarted.
+struct Ring {
+	std::mutex mutex;
+	std::vector<Span> spans; // allocated on the first span
+	size_t recorded = 0; // spans[recorded % size] is the next one
+	int tid = 0;
+	std::string name;
+	bool in_use = true; // false once its thread exited
+};
+
+// Rings of every thread that used the trace. They outlive their thread: the
+// next thread reuses them, keeping their spans on the same track, so short
+// lived threads like the solve jobs do not add a ring each.
+std::mutex rings_mutex;
+std::vector<std::unique_ptr<Ring> > rings;
+std::atomic<size_t> ring_capacity(1);
+
+// Start of the recording, spans are written relative to it
+std::atomic<int64_t> epoch(0);
+
+// Releases the ring of a thread when it exits
+struct RingOwner {
+	Ring *ring = nullptr;
+
+	~RingOwner() {
+		if (!ring) return;
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		ring->in_use = false;
+	}
+};
+
+thread_local RingOwner owner;
+
+Ring &own_ring() {
+	if (!owner.ring) {
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		for (auto &ring : rings) {
+			if (!ring->in_use) {
+				ring->in_use = true;
+				owner.ring = ring.get();
+				return *owner.ring;
+			}
+		}
+		rings.push_back(std::unique_ptr<Ring>(new Ring));
+		rings.back()->tid = (int) rings.size();
+		owner.ring = rings.back().get();
+	}
+	return *owner.ring;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void trace_start(size_t capacity) {
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	ring_capacity = std::max<size_t>(capacity, 1);
+	for (auto &ring : rings) {
+		std::lock_guard<std::mutex> ring_lock(ring->mutex);
+		ring->spans.clear();
+		ring->recorded = 0;
+	}
+	epoch = trace_clock();
+	tracing = true;
+}
+
+void trace_stop() {
+	tracing = false;
+}
+
+void trace_thread_name(const char *name) {
+	Ring &ring = own_ring();
+	std::lock_guard<std::mutex> lock(ring.mutex);
+	ring.name = name;
+}
+
+int64_t trace_clock() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_record(const char *name, int64_t start, int64_t end) {
+	Ring &ring = own_ring();
+	std::lock_guard<std::mutex> lock(ring.mutex);
+	if (ring.spans.empty()) {
+		ring.spans.resize(ring_capacity);
+	}
+	Span &span = ring.spans[ring.recorded++ % ring.spans.size()];
+	span.name = name;
+	span.start = start;
+	span.end = end;
+}
+
+bool trace_write(const std::string &path) {
+	std::ofstream file(path);
+	if (!file.is_open()) return false;
+	file << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+
+	// Complete events ("X") in microseconds, each ring copied under its lock
+	// so the thread can go on recording while the file is written
+	const char *separator = "\n";
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	for (auto &ring : rings) {
+		std::vector<Span> spans;
+		std::string name;
+		{
+			std::lock_guard<std::mutex> ring_lock(ring->mutex);
+			size_t count = std::min(ring->recorded, ring->spans.size());
+			spans.reserve(count);
+			for (size_t i = ring->recorded - count; i < ring->recorded; i++) {
+				spans.push_back(ring->spans[i % ring->spans.size()]);
+			}
+			name = ring->name;
+		}
+		if (!name.empty()) {
+			file << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->tid
+				<< ", \"args\": {\"name\": \"" << name << "\"}}";
+			separator = ",\n";
+		}
+		for (const Span &span : spans) {
+			file << separator << "{\"name\": \"" << span.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << ring->tid
+				<< ", \"ts\": " << (span.start - epoch) / 1e3 << ", \"dur\": " << (span.end - span.start) / 1e3 << "}";
+			separator = ",\n";
+		}
+	}
+	file << "\n], \"displayTimeUnit\": \"ms\"}" << std::endl;
+	return file.good();
+}
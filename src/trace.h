@@ -0,0 +1,58 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+////////////////////////////////////////////////////////////////////////////////
+
+// Timed spans of named phases (a frame, a turn, a solver depth...), written as
+// a Chrome trace that chrome://tracing and ui.perfetto.dev open. Every thread
+// records into its own ring buffer, which keeps the latest spans. Recording is
+// off until trace_start(), a span then costs a branch.
+
+// Set while recording
+extern std::atomic<bool> tracing;
+
+// Start recording, every thread keeping up to 'capacity' spans
+void trace_start(size_t capacity = 1 << 16);
+
+// Stop recording, the spans are kept until the next start
+void trace_stop();
+
+// Name the calling thread in the trace
+void trace_thread_name(const char *name);
+
+// Write the recorded spans of all the threads as JSON, false on I/O errors
+bool trace_write(const std::string &path);
+
+// Nanoseconds on a monotonic clock
+int64_t trace_clock();
+
+// Record a span on the calling thread; the name must outlive the trace
+void trace_record(const char *name, int64_t start, int64_t end);
+
+// -----------------------------------------------------------------------------
+
+// Span from its construction to the end of the scope
+class TraceSpan {
+public:
+	explicit TraceSpan(const char *name)
+		: name(tracing.load(std::memory_order_relaxed) ? name : nullptr), start(this->name ? trace_clock() : 0)
+	{ }
+
+	~TraceSpan() {
+		if (name) trace_record(name, start, trace_clock());
+	}
+
+private:
+	const char *name; // null when not recording
+	int64_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Time the rest of the scope under a string literal name
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
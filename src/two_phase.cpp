@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////////////////////////////////
+#include "two_phase.h"
+#include "trace.h"
+#include <algorithm>
+#include <cassert>
+////////////////////////////////////////////////////////////////////////////////
+
+const int phase2_moves[N_PHASE2_MOVES] = {
+	UP * 3, UP * 3 + 1, UP * 3 + 2, DO * 3, DO * 3 + 1, DO * 3 + 2,
+	RI * 3 + 1, LE * 3 + 1, FR * 3 + 1, BA * 3 + 1
+};
+
+const char *prune_table_files[N_PRUNE_TABLES] = {
+	"twist_slice.pdb", "flip_slice.pdb", "corners_slice.pdb", "edges_slice.pdb"
+};
+
+namespace {
+
+// Entries not reached yet while a table is generated
+const uint8_t unvisited = 0xf;
+
+// Breadth-first search over the product of two coordinates, starting from the
+// solved state (index 0). Entries are stored at [c2 * n1 + c1].
+void build_prune_table(PatternDatabase &table,
+	int n1, const std::vector<uint16_t> &move1,
+	int n2, const std::vector<uint16_t> &move2,
+	const int *moves, int num_moves)
+{
+	table.init(n1 * n2, unvisited);
+	std::vector<int> frontier(1, 0), next;
+	table.set(0, 0);
+	for (int depth = 0; !frontier.empty(); depth++) {
+		next.clear();
+		for (int idx : frontier) {
+			int c1 = idx % n1;
+			int c2 = idx / n1;
+			for (int i = 0; i < num_moves; i++) {
+				int m = moves[i];
+				int n = move2[c2 * NUM_MOVES + m] * n1 + move1[c1 * NUM_MOVES + m];
+				if (table.get(n) == unvisited) {
+					table.set(n, depth + 1);
+					next.push_back(n);
+				}
+			}
+		}
+		frontier.swap(next);
+	}
+}
+
+// State of one call to TwoPhaseSolver::solve
+struct Search {
+	const TwoPhaseSolver &s;
+	const CubeState &start;
+	int max_length;
+	const SolveControl *control;
+	int path[32];
+
+	Search(const TwoPhaseSolver &solver, const CubeState &state, int length, const SolveControl *c)
+		: s(solver), start(state), max_length(length), control(c) { }
+
+	bool cancelled() const {
+		return control && control->cancelled();
+	}
+
+	int phase1_bound(int twist, int flip, int slice_sorted) const {
+		int slice = slice_sorted / N_PERM_4;
+		return std::max(s.twist_slice_prune.get(slice * N_TWIST + twist),
+			s.flip_slice_prune.get(slice * N_FLIP + flip));
+	}
+
+	int phase2_bound(int corners, int ud_edges, int slice_sorted) const {
+		return std::max(s.corners_slice_prune.get(corners * N_PERM_4 + slice_sorted),
+			s.edges_slice_prune.get(ud_edges * N_PERM_4 + slice_sorted));
+	}
+
+	bool phase1(int twist, int flip, int slice_sorted, int depth, int togo) {
+		if (togo == 0) {
+			if (twist != 0 || flip != 0 || slice_sorted >= N_PERM_4) return false;
+			// Only accept phase 1 solutions that do not end with a phase 2 move,
+			// those are found again with a shorter phase 1
+			if (depth > 0) {
+				int last = path[depth - 1];
+				if (last / 3 >= UP || last % 3 == 1) return false;
+			}
+			return start_phase2(depth);
+		}
+		if (cancelled()) return false;
+		int last_face = depth > 0 ? path[depth - 1] / 3 : -1;
+		for (int m = 0; m < NUM_MOVES; m++) {
+			if (redundant_face(m / 3, last_face)) continue;
+			int t = s.twist_move[twist * NUM_MOVES + m];
+			int f = s.flip_move[flip * NUM_MOVES + m];
+			int sl = s.slice_sorted_move[slice_sorted * NUM_MOVES + m];
+			if (phase1_bound(t, f, sl) >= togo) continue;
+			path[depth] = m;
+			if (phase1(t, f, sl, depth + 1, togo - 1)) return true;
+		}
+		return false;
+	}
+
+	bool start_phase2(int depth1) {
+		TRACE_SCOPE("phase2");
+		CubeState state = start;
+		for (int i = 0; i < depth1; i++) {
+			state.move(path[i]);
+		}
+		int corners = corners_coord(state);
+		int ud_edges = ud_edges_coord(state);
+		int slice_sorted = slice_sorted_coord(state);
+		for (int len = phase2_bound(corners, ud_edges, slice_sorted); len <= max_length - depth1; len++) {
+			if (phase2(corners, ud_edges, slice_sorted, depth1, len)) {
+				max_length = depth1 + len;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool phase2(int corners, int ud_edges, int slice_sorted, int depth, int togo) {
+		if (togo == 0) return corners == 0 && ud_edges == 0 && slice_sorted == 0;
+		if (cancelled()) return false;
+		int last_face = depth > 0 ? path[depth - 1] / 3 : -1;
+		for (int i = 0; i < N_PHASE2_MOVES; i++) {
+			int m = phase2_moves[i];
+			if (redundant_face(m / 3, last_face)) continue;
+			int c = s.corners_move[corners * NUM_MOVES + m];
+			int e = s.ud_edges_move[ud_edges * NUM_MOVES + m];
+			int sl = s.slice_sorted_move[slice_sorted * NUM_MOVES + m];
+			if (phase2_bound(c, e, sl) >= togo) continue;
+			path[depth] = m;
+			if (phase2(c, e, sl, depth + 1, togo - 1)) return true;
+		}
+		return false;
+	}
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool TwoPhaseSolver::init(const std::string &dir) {
+	PatternDatabase *tables[N_PRUNE_TABLES] = {
+		&twist_slice_prune, &flip_slice_prune, &corners_slice_prune, &edges_slice_prune
+	};
+	const uint64_t sizes[N_PRUNE_TABLES] = {
+		N_SLICE * N_TWIST, N_SLICE * N_FLIP, N_CORNERS * N_PERM_4, N_UD_EDGES * N_PERM_4
+	};
+	build_move_tables();
+	ready = true;
+	for (int i = 0; i < N_PRUNE_TABLES; i++) {
+		ready = ready && load_table(*tables[i], dir + "/" + prune_table_files[i], sizes[i]);
+	}
+	return ready;
+}
+
+void TwoPhaseSolver::free() {
+	twist_slice_prune.free();
+	flip_slice_prune.free();
+	corners_slice_prune.free();
+	edges_slice_prune.free();
+	ready = false;
+}
+
+void TwoPhaseSolver::build_move_tables() {
+	int all_moves[NUM_MOVES];
+	for (int m = 0; m < NUM_MOVES; m++) all_moves[m] = m;
+
+	build_move_table(twist_move, N_TWIST, set_twist, twist_coord, all_moves, NUM_MOVES);
+	build_move_table(flip_move, N_FLIP, set_flip, flip_coord, all_moves, NUM_MOVES);
+	build_move_table(slice_sorted_move, N_SLICE_SORTED, set_slice_sorted, slice_sorted_coord, all_moves, NUM_MOVES);
+	build_move_table(corners_move, N_CORNERS, set_corners, corners_coord, phase2_moves, N_PHASE2_MOVES);
+	build_move_table(ud_edges_move, N_UD_EDGES, set_ud_edges, ud_edges_coord, phase2_moves, N_PHASE2_MOVES);
+}
+
+void TwoPhaseSolver::generate_prune_tables() {
+	int all_moves[NUM_MOVES];
+	for (int m = 0; m < NUM_MOVES; m++) all_moves[m] = m;
+
+	// The slice coordinate is slice_sorted / 24, so the sorted move table is
+	// reused with a stride of 24 for phase 1
+	std::vector<uint16_t> slice_move(N_SLICE * NUM_MOVES);
+	for (int c = 0; c < N_SLICE; c++) {
+		for (int m = 0; m < NUM_MOVES; m++) {
+			slice_move[c * NUM_MOVES + m] = slice_sorted_move[c * N_PERM_4 * NUM_MOVES + m] / N_PERM_4;
+		}
+	}
+	build_prune_table(twist_slice_prune, N_TWIST, twist_move, N_SLICE, slice_move, all_moves, NUM_MOVES);
+	build_prune_table(flip_slice_prune, N_FLIP, flip_move, N_SLICE, slice_move, all_moves, NUM_MOVES);
+
+	// In phase 2 the slice edges stay in the slice and slice_sorted is below 24
+	build_prune_table(corners_slice_prune, N_PERM_4, slice_sorted_move, N_CORNERS, corners_move, phase2_moves, N_PHASE2_MOVES);
+	build_prune_table(edges_slice_prune, N_PERM_4, slice_sorted_move, N_UD_EDGES, ud_edges_move, phase2_moves, N_PHASE2_MOVES);
+}
+
+bool TwoPhaseSolver::save(const std::string &dir) const {
+	const PatternDatabase *tables[N_PRUNE_TABLES] = {
+		&twist_slice_prune, &flip_slice_prune, &corners_slice_prune, &edges_slice_prune
+	};
+	for (int i = 0; i < N_PRUNE_TABLES; i++) {
+		if (!tables[i]->save(dir + "/" + prune_table_files[i])) return false;
+	}
+	return true;
+}
+
+bool TwoPhaseSolver::solve(const CubeState &state, std::vector<int> &solution, int max_length,
+	SolveControl *control) const
+{
+	assert(ready);
+	assert(max_length < 32);
+	solution.clear();
+	if (state.is_solved()) return true;
+
+	Search search(*this, state, max_length, control);
+	int twist = twist_coord(state);
+	int flip = flip_coord(state);
+	int slice_sorted = slice_sorted_coord(state);
+	for (int depth = search.phase1_bound(twist, flip, slice_sorted); depth <= max_length; depth++) {
+		if (control) {
+			if (control->cancelled()) return false;
+			control->depth = depth;
+		}
+		TRACE_SCOPE("phase1_depth");
+		if (search.phase1(twist, flip, slice_sorted, 0, depth)) {
+			solution.assign(search.path, search.path + search.max_length);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+#include "coordinates.h"
+#include "pattern_database.h"
+#include "solve_control.h"
+#include <string>
+////////////////////////////////////////////////////////////////////////////////
+
+// Moves allowed in phase 2: U, D and half turns of the side faces
+#define N_PHASE2_MOVES 10
+
+// Number of pruning tables
+#define N_PRUNE_TABLES 4
+
+// -----------------------------------------------------------------------------
+
+// Kociemba's two-phase solver. Phase 1 brings the cube into the subgroup
+// G1 = <U, D, R2, L2, F2, B2>, phase 2 solves it using only moves of G1.
+class TwoPhaseSolver {
+public:
+	// Move tables, indexed by [coordinate * NUM_MOVES + move]
+	std::vector<uint16_t> twist_move;
+	std::vector<uint16_t> flip_move;
+	std::vector<uint16_t> slice_sorted_move;
+	std::vector<uint16_t> corners_move;  // only valid for phase 2 moves
+	std::vector<uint16_t> ud_edges_move; // only valid for phase 2 moves
+
+	// Pruning tables, each entry is a lower bound on the moves left
+	PatternDatabase twist_slice_prune;   // [slice * N_TWIST + twist]
+	PatternDatabase flip_slice_prune;    // [slice * N_FLIP + flip]
+	PatternDatabase corners_slice_prune; // [corners * N_PERM_4 + slice perm]
+	PatternDatabase edges_slice_prune;   // [ud edges * N_PERM_4 + slice perm]
+
+	// True once the tables are available
+	bool ready;
+
+	TwoPhaseSolver() : ready(false) { }
+
+	// Compute the move tables and map the pruning tables from the files in
+	// 'dir', written by generate_tables
+	bool init(const std::string &dir);
+
+	// Release the pruning tables
+	void free();
+
+	// Compute the move tables
+	void build_move_tables();
+
+	// Compute the pruning tables in memory, from the move tables
+	void generate_prune_tables();
+
+	// Write the pruning tables to the files in 'dir'
+	bool save(const std::string &dir) const;
+
+	// Find a sequence of at most max_length moves (see CubeState::move) that
+	// solves the state. Returns false if there is none within the limit or
+	// the solve was cancelled through 'control'.
+	bool solve(const CubeState &state, std::vector<int> &solution, int max_length = 22,
+		SolveControl *control = NULL) const;
+};
+
+// -----------------------------------------------------------------------------
+
+// The moves of phase 2, as indices into the 18 face turn moves
+extern const int phase2_moves[N_PHASE2_MOVES];
+
+// File names of the pruning tables inside the table directory
+extern const char *prune_table_files[N_PRUNE_TABLES];